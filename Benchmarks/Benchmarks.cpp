@@ -0,0 +1,1298 @@
+#include "RTWeekend.h"
+
+#include "BVH.h"
+#include "Camera.h"
+#include "Denoiser.h"
+#include "FlatBVH.h"
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Instance.h"
+#include "MaterialTable.h"
+#include "ObjLoader.h"
+#include "SceneBuilder.h"
+#include "SceneFile.h"
+#include "Sphere.h"
+#include "SphereSet.h"
+#include "TriangleMesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <malloc.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+// microbenchmarks of the hot paths, results are written to stdout as JSON
+// usage: Benchmarks [--filter <substring>] [--min-time <seconds>]
+
+struct BenchmarkResult
+{
+	std::string name;
+	long long ops;
+	double seconds;
+	std::vector<std::pair<std::string, double>> metrics;		// extra figures some cases report, e.g. image noise
+};
+
+struct BenchmarkOptions
+{
+	std::string filter;
+	double min_time = 0.25;
+};
+
+// results of the code under test are folded into this, so the compiler cannot drop the work
+static volatile double sink;
+
+static double elapsed_seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double resident_bytes()
+{
+	// current resident set size, only known on Linux, 0 elsewhere
+#ifdef __linux__
+	std::ifstream statm("/proc/self/statm");
+	double total_pages = 0, resident_pages = 0;
+	if (statm >> total_pages >> resident_pages)
+		return resident_pages * sysconf(_SC_PAGESIZE);
+#endif
+	return 0;
+}
+
+static double peak_resident_bytes()
+{
+	// the most resident memory since the last reset_peak_resident, only known on Linux, 0 elsewhere
+#ifdef __linux__
+	std::ifstream status("/proc/self/status");
+	std::string key;
+	while (status >> key)
+	{
+		if (key == "VmHWM:")
+		{
+			double kilobytes = 0;
+			status >> kilobytes;
+			return kilobytes * 1024;
+		}
+		std::getline(status, key);
+	}
+#endif
+	return 0;
+}
+
+static void reset_peak_resident()
+{
+	// lowers the peak to the current resident size, after handing the heap memory freed by earlier cases back to the
+	// system, where it would otherwise be counted as resident and reused without raising the peak
+#ifdef __linux__
+	malloc_trim(0);
+	std::ofstream clear_refs("/proc/self/clear_refs");
+	clear_refs << "5";
+#endif
+}
+
+class CacheMissCounter
+{
+public:
+	// last level cache misses of the calling thread from the hardware counters, where the kernel exposes them, which
+	// virtual machines often do not, available() is false there and on anything but Linux
+	CacheMissCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+	}
+
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	CacheMissCounter(const CacheMissCounter&) = delete;
+	CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+	bool available() const { return fd >= 0; }
+
+	void start()
+	{
+#ifdef __linux__
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	long long stop()
+	{
+		long long count = 0;
+#ifdef __linux__
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) != sizeof(count))
+			count = 0;
+#endif
+		return count;
+	}
+
+private:
+	int fd = -1;
+};
+
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(const BenchmarkOptions& options) : options(options) {}
+
+	// batch runs ops_per_batch operations, batches repeat until min_time has passed
+	void run(const std::string& name, long long ops_per_batch, const std::function<void()>& batch)
+	{
+		if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+			return;
+
+		// every case starts from the same generator state, so runs are comparable across builds
+		seed_random(0x5eed, std::hash<std::string>()(name));
+		batch();
+
+		long long ops = 0;
+		auto start = std::chrono::steady_clock::now();
+		do
+		{
+			batch();
+			ops += ops_per_batch;
+		} while (elapsed_seconds(start) < options.min_time);
+
+		record(name, ops, elapsed_seconds(start));
+	}
+
+	// for cases that do their own timing, e.g. across several threads
+	void record(const std::string& name, long long ops, double seconds)
+	{
+		results.push_back({ name, ops, seconds, {} });
+		std::clog << name << ": " << 1e9 * seconds / ops << " ns/op\n";
+	}
+
+	// attaches a named figure to the case that was recorded last
+	void metric(const std::string& key, double value)
+	{
+		results.back().metrics.emplace_back(key, value);
+		std::clog << "  " << key << ": " << value << "\n";
+	}
+
+	const BenchmarkResult* last_result(const std::string& name) const
+	{
+		return !results.empty() && results.back().name == name ? &results.back() : nullptr;
+	}
+
+	bool selected(const std::string& name) const
+	{
+		return options.filter.empty() || name.find(options.filter) != std::string::npos;
+	}
+
+	const BenchmarkOptions& settings() const { return options; }
+
+	void write_json(std::ostream& out) const
+	{
+		out << "{\n";
+#ifdef RT_SINGLE_PRECISION
+		out << "  \"precision\": \"float\",\n";
+#else
+		out << "  \"precision\": \"double\",\n";
+#endif
+#if defined(RT_SIMD_AVX)
+		out << "  \"simd\": \"avx\",\n";
+#elif defined(RT_SIMD_SSE2)
+		out << "  \"simd\": \"sse2\",\n";
+#else
+		out << "  \"simd\": \"scalar\",\n";
+#endif
+		out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+		out << "  \"benchmarks\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const BenchmarkResult& r = results[i];
+			out << "    { \"name\": \"" << r.name << "\""
+				<< ", \"ops\": " << r.ops
+				<< ", \"seconds\": " << r.seconds
+				<< ", \"ns_per_op\": " << 1e9 * r.seconds / r.ops
+				<< ", \"ops_per_sec\": " << r.ops / r.seconds;
+			for (const auto& m : r.metrics)
+				out << ", \"" << m.first << "\": " << m.second;
+			out << " }"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+private:
+	BenchmarkOptions options;
+	std::vector<BenchmarkResult> results;
+};
+
+static const int NUM_RAYS = 1024;
+
+static std::vector<Ray> rays_at_unit_sphere(double hit_fraction)
+{
+	// rays from random points on a sphere of radius 10 around the origin, the first hit_fraction of them aimed at
+	// a point inside the unit sphere and the rest at a point well outside it
+	std::vector<Ray> rays;
+	for (int i = 0; i < NUM_RAYS; i++)
+	{
+		Point3 origin = 10 * random_unit_vector();
+		Point3 target = i < hit_fraction * NUM_RAYS
+			? Real(0.9) * random_in_unit_sphere()
+			: 3 * unit_vector(cross(origin, random_unit_vector())) + random_in_unit_sphere();
+		rays.push_back(Ray(origin, target - origin));
+	}
+	return rays;
+}
+
+static std::vector<Ray> rays_through_box(const AABB& box, int count)
+{
+	// rays between random points of a box grown by half its size, so a mix of hits and misses
+	std::vector<Ray> rays;
+	for (int i = 0; i < count; i++)
+	{
+		Point3 p[2];
+		for (int k = 0; k < 2; k++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const Interval& ax = box.axis_interval(axis);
+				p[k][axis] = Real(random_double(ax.min - 0.25 * ax.size(), ax.max + 0.25 * ax.size()));
+			}
+		}
+		rays.push_back(Ray(p[0], p[1] - p[0]));
+	}
+	return rays;
+}
+
+static void random_spheres(HittableList& world, int count, int material)
+{
+	// non-overlapping only by chance, spread so that about half of rays_through_box hits something
+	for (int i = 0; i < count; i++)
+	{
+		Point3 center = Vec3::random(-10, 10);
+		world.add(std::make_shared<Sphere>(center, Real(random_double(0.2, 1.0)), material));
+	}
+}
+
+static void book_scene(HittableList& world, MaterialTable& materials)
+{
+	// the scene of main.cpp
+	world.add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, materials.add(Lambertian(Color(0.5, 0.5, 0.5)))));
+
+	for (int a = -11; a < 11; a++)
+	{
+		for (int b = -11; b < 11; b++)
+		{
+			double choose_mat = random_double();
+			Point3 center(Real(a + 0.9 * random_double()), Real(0.2), Real(b + 0.9 * random_double()));
+			if ((center - Point3(4, Real(0.2), 0)).length() <= 0.9)
+				continue;
+
+			int sphere_mat;
+			if (choose_mat < 0.6)
+				sphere_mat = materials.add(Lambertian(Color::random() * Color::random()));
+			else if (choose_mat < 0.9)
+				sphere_mat = materials.add(Metal(Color::random(0.5, 1.0), Real(random_double(0, 0.5))));
+			else
+				sphere_mat = materials.add(Dielectric(Real(1.5)));
+			world.add(std::make_shared<Sphere>(center, Real(0.2), sphere_mat));
+		}
+	}
+
+	world.add(std::make_shared<Sphere>(Point3(-4, 1, 0), 1, materials.add(Lambertian(Color(Real(0.4), Real(0.2), Real(0.1))))));
+	world.add(std::make_shared<Sphere>(Point3(0, 1, 0), 1, materials.add(Dielectric(Real(1.5)))));
+	world.add(std::make_shared<Sphere>(Point3(4, 1, 0), 1, materials.add(Metal(Color(Real(0.7), Real(0.6), Real(0.5)), 0))));
+}
+
+static void book_camera(Camera& camera, int samples_per_pixel)
+{
+	// the main.cpp camera looking at book_scene, shrunk to a 96x54 image rendered on one thread
+	camera.aspect_ratio = 16.0 / 9.0;
+	camera.image_width = 96;
+	camera.samples_per_pixel = samples_per_pixel;
+	camera.max_depth = 50;
+	camera.vfov = 20;
+	camera.lookfrom = Point3(13, 2, 3);
+	camera.lookat = Point3(0, 0, 0);
+	camera.defocus_angle = 0.6;
+	camera.focus_dist = 10.0;
+	camera.num_threads = 1;
+	camera.show_progress = false;
+}
+
+static void room_camera(Camera& camera, int samples_per_pixel)
+{
+	// the Scenes/room.scene camera, shrunk to a 96x64 image rendered on one thread
+	camera.aspect_ratio = 1.5;
+	camera.image_width = 96;
+	camera.samples_per_pixel = samples_per_pixel;
+	camera.max_depth = 10;
+	camera.vfov = 50;
+	camera.lookfrom = Point3(0, 2, 9);
+	camera.lookat = Point3(0, 1.5, 0);
+	camera.focus_dist = 9;
+	camera.num_threads = 1;
+	camera.show_progress = false;
+}
+
+static int trace_packets(const Hittable& world, const std::vector<Ray>& rays, const std::vector<char>& valid, int size)
+{
+	// rays in runs of size, each run traced as one packet of its valid lanes, all of them without valid
+	RayPacket packet;
+	packet.clear();
+	packet.size = size;
+	HitRecord recs[RayPacket::MAX_SIZE];
+	Real t_max[RayPacket::MAX_SIZE];
+	int hits = 0;
+	for (size_t first = 0; first < rays.size(); first += size)
+	{
+		int lane_mask = 0;
+		for (int lane = 0; lane < size && first + lane < rays.size(); lane++)
+		{
+			if (valid.empty() || valid[first + lane])
+			{
+				packet.set(lane, rays[first + lane]);
+				lane_mask |= 1 << lane;
+			}
+		}
+
+		std::fill(t_max, t_max + RayPacket::MAX_SIZE, Real(INF));
+		hits += RayPacket::lane_count(world.hit_packet(packet, lane_mask, Epsilon<Real>::ray_t_min(), t_max, recs));
+	}
+	return hits;
+}
+
+static void intersection_benchmarks(BenchmarkRunner& runner)
+{
+	MaterialTable materials;
+	int material = materials.add(Lambertian(Color(Real(0.5), Real(0.5), Real(0.5))));
+	HitRecord rec;
+
+	Sphere sphere(Point3(0, 0, 0), 1, material);
+	const double hit_fractions[] = { 1.0, 0.5, 0.0 };
+	const char* hit_names[] = { "all_hit", "half_hit", "all_miss" };
+	for (int k = 0; k < 3; k++)
+	{
+		std::vector<Ray> rays = rays_at_unit_sphere(hit_fractions[k]);
+		runner.run(std::string("sphere_hit/") + hit_names[k], NUM_RAYS, [&]()
+		{
+			int hits = 0;
+			for (const Ray& r : rays)
+				hits += sphere.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+			sink = sink + hits;
+		});
+	}
+
+	AABB box(Point3(-1, -1, -1), Point3(1, 1, 1));
+	std::vector<Ray> box_rays = rays_through_box(box, NUM_RAYS);
+	runner.run("aabb_hit/mixed", NUM_RAYS, [&]()
+	{
+		int hits = 0;
+		for (const Ray& r : box_rays)
+			hits += box.hit(r, Interval(0, Real(INF)));
+		sink = sink + hits;
+	});
+
+	for (int count : { 1, 4, 16, 64, 256 })
+	{
+		HittableList list;
+		random_spheres(list, count, material);
+		SphereSet set(list);
+		std::vector<Ray> rays = rays_through_box(list.bounding_box(), NUM_RAYS);
+
+		runner.run("hittable_list_hit/" + std::to_string(count), NUM_RAYS, [&]()
+		{
+			int hits = 0;
+			for (const Ray& r : rays)
+				hits += list.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+			sink = sink + hits;
+		});
+
+		runner.run("sphere_set_hit/" + std::to_string(count), NUM_RAYS, [&]()
+		{
+			int hits = 0;
+			for (const Ray& r : rays)
+				hits += set.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+			sink = sink + hits;
+		});
+	}
+
+	// whole-scene queries against the main.cpp scene through each acceleration structure
+	HittableList scene;
+	MaterialTable scene_materials;
+	book_scene(scene, scene_materials);
+	BVHNode bvh(scene);
+	FlatBVH flat_bvh(scene);
+
+	std::vector<Ray> scene_rays;
+	for (int i = 0; i < NUM_RAYS; i++)
+		scene_rays.push_back(Ray(Point3(13, 2, 3), Point3(Real(random_double(-8, 8)), Real(random_double(-1, 2)), Real(random_double(-8, 8))) - Point3(13, 2, 3)));
+
+	const std::pair<const char*, const Hittable*> structures[] = {
+		{ "scene_hit/hittable_list", &scene }, { "scene_hit/bvh", &bvh }, { "scene_hit/flat_bvh", &flat_bvh } };
+	for (const auto& structure : structures)
+	{
+		runner.run(structure.first, NUM_RAYS, [&]()
+		{
+			int hits = 0;
+			for (const Ray& r : scene_rays)
+				hits += structure.second->hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+			sink = sink + hits;
+		});
+	}
+
+	runner.run("scene_hit/flat_bvh_packet", NUM_RAYS, [&]()
+	{
+		sink = sink + trace_packets(flat_bvh, scene_rays, std::vector<char>(), RayPacket::GROUP);
+	});
+
+	// the camera rays of a 384x216 render of the same scene, which packets are meant for, in 4x4 pixel blocks so
+	// that every run of 4, 8 or 16 rays is one packet of Camera::render_block_packet
+	// the reflection rays are those of the camera rays that hit Metal with fuzz up to the default
+	// Camera::packet_reflection_fuzz, in the same lanes
+	Camera camera(flat_bvh, scene_materials);
+	book_camera(camera, 1);
+	camera.image_width = 384;
+	std::vector<Ray> camera_rays, reflection_rays;
+	std::vector<char> reflects;
+	int reflection_count = 0;
+	for (int by = 0; by < 216; by += 4)
+	{
+		for (int bx = 0; bx < 384; bx += 4)
+		{
+			for (int j = by; j < by + 4; j++)
+			{
+				for (int i = bx; i < bx + 4; i++)
+				{
+					Ray r = camera.camera_ray(i, j, 0);
+					camera_rays.push_back(r);
+
+					HitRecord camera_rec;
+					Color attenuation;
+					Ray reflected;
+					bool reflection = flat_bvh.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), camera_rec)
+						&& scene_materials[camera_rec.material_id].type() == MaterialType::Metal
+						&& scene_materials[camera_rec.material_id].fuzziness() <= camera.packet_reflection_fuzz
+						&& scene_materials[camera_rec.material_id].scatter(r, camera_rec, attenuation, reflected);
+					reflection_rays.push_back(reflection ? reflected : r);
+					reflects.push_back(reflection);
+					reflection_count += reflection;
+				}
+			}
+		}
+	}
+
+	runner.run("camera_hit/flat_bvh", int(camera_rays.size()), [&]()
+	{
+		int hits = 0;
+		for (const Ray& r : camera_rays)
+			hits += flat_bvh.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+		sink = sink + hits;
+	});
+
+	for (int size : { 4, 8, 16 })
+	{
+		runner.run("camera_hit/flat_bvh_packet" + std::to_string(size), int(camera_rays.size()), [&]()
+		{
+			sink = sink + trace_packets(flat_bvh, camera_rays, std::vector<char>(), size);
+		});
+	}
+
+	runner.run("reflection_hit/flat_bvh", reflection_count, [&]()
+	{
+		int hits = 0;
+		for (size_t i = 0; i < reflection_rays.size(); i++)
+		{
+			if (reflects[i])
+				hits += flat_bvh.hit(reflection_rays[i], Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+		}
+		sink = sink + hits;
+	});
+
+	for (int size : { 4, 8, 16 })
+	{
+		runner.run("reflection_hit/flat_bvh_packet" + std::to_string(size), reflection_count, [&]()
+		{
+			sink = sink + trace_packets(flat_bvh, reflection_rays, reflects, size);
+		});
+	}
+}
+
+static void instancing_benchmarks(BenchmarkRunner& runner)
+{
+	// a field of copies of one 64 sphere cluster, either as Instances sharing the cluster's FlatBVH or flattened
+	// into one Sphere per copy, with the resident memory each way of building it added
+	const int count = 10000;
+	const std::string instanced_name = "instancing/instances/" + std::to_string(count);
+	const std::string flattened_name = "instancing/flattened/" + std::to_string(count);
+
+	SphereSet cluster;
+	for (int i = 0; i < 64; i++)
+		cluster.add(Vec3::random(-1, 1), Real(random_double(0.05, 0.2)), 0);
+	std::shared_ptr<Hittable> cluster_bvh = std::make_shared<FlatBVH>(cluster);
+
+	std::vector<Transform> placements;
+	int side = int(std::ceil(std::sqrt(double(count))));
+	for (int i = 0; i < count; i++)
+	{
+		placements.push_back(Transform::translate(Vec3(Real(3 * (i % side)), 0, Real(3 * (i / side))))
+			* Transform::rotate(Vec3(0, 1, 0), random_double(0, 360))
+			* Transform::scale(Real(random_double(0.5, 1.0))));
+	}
+
+	// every ray is aimed into the field, so both versions answer the same queries
+	HitRecord rec;
+	std::vector<Ray> rays;
+	for (int i = 0; i < NUM_RAYS; i++)
+	{
+		Point3 target(Real(random_double(0, 3.0 * side)), 0, Real(random_double(0, 3.0 * side)));
+		rays.push_back(Ray(Point3(Real(1.5 * side), 20, Real(-10)), target - Point3(Real(1.5 * side), 20, Real(-10))));
+	}
+
+	auto measure = [&](const std::string& name, const Hittable& world, double bytes)
+	{
+		runner.run(name, NUM_RAYS, [&]()
+		{
+			int hits = 0;
+			for (const Ray& r : rays)
+				hits += world.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+			sink = sink + hits;
+		});
+		if (runner.last_result(name))
+			runner.metric("resident_bytes", bytes);
+	};
+
+	if (runner.selected(instanced_name))
+	{
+		double before = resident_bytes();
+		HittableList instances;
+		for (const Transform& placement : placements)
+			instances.add(std::make_shared<Instance>(cluster_bvh, placement));
+		FlatBVH world(instances);
+		double bytes = resident_bytes() - before;
+
+		measure(instanced_name, world, bytes);
+	}
+
+	if (runner.selected(flattened_name))
+	{
+		// rotations and uniform scales keep spheres spheres, so flattening is exact
+		double before = resident_bytes();
+		HittableList copies;
+		for (const Transform& placement : placements)
+		{
+			for (int s = 0; s < cluster.size(); s++)
+			{
+				if (cluster.is_padding(s))
+					continue;
+
+				Real radius = placement.vector(Vec3(cluster.radius(s), 0, 0)).length();
+				copies.add(std::make_shared<Sphere>(placement.point(cluster.center(s)), radius, 0));
+			}
+		}
+		FlatBVH world(copies);
+		double bytes = resident_bytes() - before;
+
+		measure(flattened_name, world, bytes);
+	}
+}
+
+static void sampling_benchmarks(BenchmarkRunner& runner)
+{
+	const int n = 1024;
+
+	runner.run("random_double", n, [&]()
+	{
+		double sum = 0;
+		for (int i = 0; i < n; i++)
+			sum += random_double();
+		sink = sink + sum;
+	});
+
+	runner.run("random_unit_vector", n, [&]()
+	{
+		Vec3 sum;
+		for (int i = 0; i < n; i++)
+			sum += random_unit_vector();
+		sink = sink + sum.x();
+	});
+
+	runner.run("random_in_unit_disk", n, [&]()
+	{
+		Vec3 sum;
+		for (int i = 0; i < n; i++)
+			sum += random_in_unit_disk();
+		sink = sink + sum.x();
+	});
+
+	// a camera sample's worth of dimensions from each sampler: the pixel, the lens and two bounces, ops are 2D samples
+	for (SamplerType type : { SamplerType::Independent, SamplerType::Stratified, SamplerType::Sobol, SamplerType::BlueNoise })
+	{
+		int sample = 0;
+		runner.run(std::string("sample_2d/") + sampler_name(type), n, [&]()
+		{
+			double sum = 0;
+			for (int i = 0; i < n; i += 4)
+			{
+				start_sample(type, i % 64, i / 64, 64, 64, sample++ % 64, 64);
+				for (int k = 0; k < 4; k++)
+				{
+					Sample2D s = sample_2d();
+					sum += s.u + s.v;
+				}
+			}
+			sink = sink + sum;
+		});
+	}
+
+	// random_double from every thread at once, ops_per_sec is the total so it should scale with the thread count
+	unsigned max_threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+	{
+		std::string name = "random_double_threads/" + std::to_string(num_threads);
+		if (!runner.selected(name))
+			continue;
+
+		std::vector<long long> ops(num_threads, 0);
+		std::vector<std::thread> threads;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned t = 0; t < num_threads; t++)
+		{
+			threads.emplace_back([&, t]()
+			{
+				seed_random(0x5eed, t);
+				double sum = 0;
+				do
+				{
+					for (int i = 0; i < n; i++)
+						sum += random_double();
+					ops[t] += n;
+				} while (elapsed_seconds(start) < runner.settings().min_time);
+				sink = sink + sum;
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+
+		long long total = 0;
+		for (long long o : ops)
+			total += o;
+		runner.record(name, total, elapsed_seconds(start));
+	}
+}
+
+static void shading_benchmarks(BenchmarkRunner& runner)
+{
+	MaterialTable materials;
+	const std::pair<const char*, int> cases[] = {
+		{ "scatter/lambertian", materials.add(Lambertian(Color(Real(0.5), Real(0.5), Real(0.5)))) },
+		{ "scatter/metal", materials.add(Metal(Color(Real(0.7), Real(0.6), Real(0.5)), Real(0.3))) },
+		{ "scatter/dielectric", materials.add(Dielectric(Real(1.5))) } };
+
+	// a fixed set of incoming rays hitting the top of a unit sphere from random directions above it
+	const int n = 256;
+	std::vector<Ray> rays;
+	std::vector<HitRecord> recs(n);
+	for (int i = 0; i < n; i++)
+	{
+		Vec3 normal = unit_vector(Vec3(Real(random_double(-0.5, 0.5)), 1, Real(random_double(-0.5, 0.5))));
+		Vec3 incoming = -random_on_hemisphere(normal);
+		rays.push_back(Ray(normal - incoming, incoming));
+		recs[i].p = normal;
+		recs[i].t = 1;
+		recs[i].set_face_normal(rays[i], normal);
+	}
+
+	for (const auto& c : cases)
+	{
+		const Material& mat = materials[c.second];
+		runner.run(c.first, n, [&]()
+		{
+			Color sum;
+			Ray scattered;
+			Color attenuation;
+			for (int i = 0; i < n; i++)
+			{
+				if (mat.scatter(rays[i], recs[i], attenuation, scattered))
+					sum += attenuation * scattered.direction();
+			}
+			sink = sink + sum.x();
+		});
+	}
+}
+
+static void output_benchmarks(BenchmarkRunner& runner)
+{
+	const int n = 1024;
+	std::vector<Color> colors;
+	for (int i = 0; i < n; i++)
+		colors.push_back(Color::random(0, 1.2));
+
+	runner.run("color_to_bytes", n, [&]()
+	{
+		unsigned char rgb[3];
+		int sum = 0;
+		for (const Color& c : colors)
+		{
+			color_to_bytes(c, rgb);
+			sum += rgb[0] + rgb[1] + rgb[2];
+		}
+		sink = sink + sum;
+	});
+
+	std::ostringstream out;
+	runner.run("write_color", n, [&]()
+	{
+		out.str(std::string());
+		for (const Color& c : colors)
+			write_color(out, c);
+		sink = sink + double(out.tellp());
+	});
+}
+
+static void render_benchmarks(BenchmarkRunner& runner)
+{
+	// small renders of the main.cpp scene on one thread, ops are camera samples
+	// every case also reports the mean per-sample luminance variance of its image and that variance times the
+	// time per sample, which is proportional to the time needed to reach a given noise level
+	HittableList scene;
+	MaterialTable materials;
+	book_scene(scene, materials);
+	HittableList world(std::make_shared<FlatBVH>(scene));
+
+	struct RenderMode
+	{
+		const char* name;
+		int packet_size;		// 0 traces single rays
+		Integrator integrator;
+		bool roulette;
+		bool progressive;		// the same samples in passes of 1, 1 and 2, with the noise measured after each
+	};
+	const RenderMode modes[] = {
+		{ "render/recursive", 0, Integrator::Recursive, false, false },
+		{ "render/packet", 4, Integrator::Recursive, false, false },
+		{ "render/packet16", 16, Integrator::Recursive, false, false },
+		{ "render/wavefront", 0, Integrator::Wavefront, false, false },
+		{ "render/recursive_roulette", 0, Integrator::Recursive, true, false },
+		{ "render/wavefront_roulette", 0, Integrator::Wavefront, true, false },
+		{ "render/progressive", 0, Integrator::Recursive, false, true },
+	};
+	for (const RenderMode& mode : modes)
+	{
+		Camera camera(world, materials);
+		book_camera(camera, 4);
+		camera.packet_tracing = mode.packet_size > 0;
+		camera.packet_size = mode.packet_size;
+		camera.integrator = mode.integrator;
+		camera.russian_roulette = mode.roulette;
+		camera.progressive = mode.progressive;
+		camera.target_noise = 1e-9;		// progressive only, never reached, so every pass is taken
+
+		long long samples = 96LL * 54 * camera.samples_per_pixel;
+		runner.run(mode.name, samples, [&]()
+		{
+			camera.render_framebuffer();
+			sink = sink + camera.framebuffer().pixel(48, 27).x();
+		});
+
+		const BenchmarkResult* result = runner.last_result(mode.name);
+		if (!result)
+			continue;
+
+		const Framebuffer& fb = camera.framebuffer();
+		double variance = 0;
+		for (int j = 0; j < fb.height(); j++)
+		{
+			for (int i = 0; i < fb.width(); i++)
+				variance += fb.luminance_variance(i, j);
+		}
+		variance /= double(fb.width()) * fb.height();
+		runner.metric("sample_variance", variance);
+		runner.metric("variance_seconds", variance * result->seconds / result->ops);
+	}
+
+	// the same render at 16 samples per pixel from each sampler, with its RMSE against a 1024 sample reference, and
+	// the RMSE left after a 3x3 box blur, which is what remains of the error at low frequencies
+	const SamplerType samplers[] = { SamplerType::Independent, SamplerType::Stratified, SamplerType::Sobol, SamplerType::BlueNoise };
+	bool any_selected = false;
+	for (SamplerType type : samplers)
+		any_selected = any_selected || runner.selected(std::string("render_sampler/") + sampler_name(type));
+	if (!any_selected)
+		return;
+
+	Camera reference(world, materials);
+	book_camera(reference, 1024);
+	reference.sampler = SamplerType::Sobol;
+	reference.num_threads = 0;
+	reference.render_framebuffer();
+	const Framebuffer& truth = reference.framebuffer();
+
+	for (SamplerType type : samplers)
+	{
+		const std::string name = std::string("render_sampler/") + sampler_name(type);
+		Camera camera(world, materials);
+		book_camera(camera, 16);
+		camera.sampler = type;
+		runner.run(name, 96LL * 54 * camera.samples_per_pixel, [&]()
+		{
+			camera.render_framebuffer();
+			sink = sink + camera.framebuffer().pixel(48, 27).x();
+		});
+		if (!runner.last_result(name))
+			continue;
+
+		const Framebuffer& fb = camera.framebuffer();
+		double error = 0, blurred_error = 0;
+		for (int j = 0; j < fb.height(); j++)
+		{
+			for (int i = 0; i < fb.width(); i++)
+			{
+				double e = luminance(fb.pixel(i, j)) - luminance(truth.pixel(i, j));
+				error += e * e;
+				if (i == 0 || j == 0 || i == fb.width() - 1 || j == fb.height() - 1)
+					continue;
+
+				double blurred = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+						blurred += luminance(fb.pixel(i + dx, j + dy)) - luminance(truth.pixel(i + dx, j + dy));
+				}
+				blurred_error += (blurred / 9) * (blurred / 9);
+			}
+		}
+		runner.metric("rmse", std::sqrt(error / (double(fb.width()) * fb.height())));
+		runner.metric("blurred_rmse", std::sqrt(blurred_error / (double(fb.width() - 2) * (fb.height() - 2))));
+	}
+}
+
+static void light_benchmarks(BenchmarkRunner& runner)
+{
+	// the room of Scenes/room.scene, lit only by a small lamp, at 16 samples per pixel with and without next-event
+	// estimation, each with its luminance RMSE against a 512 sample next-event render and that error squared times the
+	// time per sample, which is proportional to the time either needs to reach a given noise level
+	struct LightMode
+	{
+		const char* name;
+		bool next_event_estimation;
+		Integrator integrator;
+	};
+	const LightMode modes[] = {
+		{ "render_lights/bsdf", false, Integrator::Recursive },
+		{ "render_lights/nee", true, Integrator::Recursive },
+		{ "render_lights/nee_wavefront", true, Integrator::Wavefront },
+	};
+	bool any_selected = false;
+	for (const LightMode& mode : modes)
+		any_selected = any_selected || runner.selected(mode.name);
+	if (!any_selected)
+		return;
+
+	SphereSet spheres;
+	MaterialTable materials;
+	spheres.add(Point3(0, 0, 0), 14, materials.add(Lambertian(Color(Real(0.7), Real(0.7), Real(0.7)))));
+	spheres.add(Point3(0, -1000, 0), 1000, materials.add(Lambertian(Color(Real(0.6), Real(0.5), Real(0.4)))));
+	spheres.add(Point3(-2.2, 1, 0), 1, materials.add(Lambertian(Color(Real(0.7), Real(0.15), Real(0.1)))));
+	spheres.add(Point3(2.2, 1, 0), 1, materials.add(Metal(Color(Real(0.8), Real(0.8), Real(0.85)), Real(0.1))));
+	spheres.add(Point3(0, 0.7, 2.2), 0.7, materials.add(Dielectric(Real(1.5))));
+	spheres.add(Point3(0, 5.5, -1), 0.4, materials.add(DiffuseLight(Color(40, 36, 30))));
+	FlatBVH world(spheres);
+	const LightList lights(spheres, materials);
+
+	Camera reference(world, materials);
+	room_camera(reference, 512);
+	reference.lights = lights;
+	reference.num_threads = 0;
+	reference.render_framebuffer();
+	const Framebuffer& truth = reference.framebuffer();
+
+	for (const LightMode& mode : modes)
+	{
+		Camera camera(world, materials);
+		room_camera(camera, 16);
+		camera.lights = lights;
+		camera.next_event_estimation = mode.next_event_estimation;
+		camera.integrator = mode.integrator;
+		runner.run(mode.name, 96LL * 64 * camera.samples_per_pixel, [&]()
+		{
+			camera.render_framebuffer();
+			sink = sink + camera.framebuffer().pixel(48, 32).x();
+		});
+
+		const BenchmarkResult* result = runner.last_result(mode.name);
+		if (!result)
+			continue;
+
+		const Framebuffer& fb = camera.framebuffer();
+		double error = 0;
+		for (int j = 0; j < fb.height(); j++)
+		{
+			for (int i = 0; i < fb.width(); i++)
+			{
+				double e = luminance(fb.pixel(i, j)) - luminance(truth.pixel(i, j));
+				error += e * e;
+			}
+		}
+		double mse = error / (double(fb.width()) * fb.height());
+		runner.metric("rmse", std::sqrt(mse));
+		runner.metric("mse_seconds", mse * result->seconds / result->ops);
+	}
+}
+
+static void denoise_benchmarks(BenchmarkRunner& runner)
+{
+	// the wavelet filter on a 4K framebuffer of noisy samples over flat albedo and banded normals, ops are pixels
+	const int width = 3840, height = 2160;
+	Framebuffer noisy;
+	noisy.resize(width, height, true);
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			Color sample = Color(0.5, 0.5, 0.5) + 0.2 * Color::random(-1, 1);
+			noisy.add_samples(i, j, 4 * sample, 4 * luminance(sample) * luminance(sample) + 0.01, 4);
+			noisy.add_features(i, j, 4 * Color(0.5, 0.5, 0.5), 4 * Vec3(0, (i / 64) % 2, 1), 4);
+		}
+	}
+
+	Denoiser denoiser;
+	runner.run("denoise/3840x2160", (long long)width * height, [&]()
+	{
+		Framebuffer filtered = denoiser.run(noisy);
+		sink = sink + filtered.pixel(width / 2, height / 2).x();
+	});
+}
+
+static void scene_benchmarks(BenchmarkRunner& runner)
+{
+	// a million small spheres saved in both formats, ops are spheres loaded, built into a FlatBVH or refitted in it
+	const int count = 1000000;
+	const std::string load_binary = "scene_load/binary/" + std::to_string(count);
+	const std::string load_text = "scene_load/text/" + std::to_string(count);
+	const std::string build_bvh = "scene_build/flat_bvh/" + std::to_string(count);
+	const std::string refit_bvh = "scene_refit/flat_bvh/" + std::to_string(count);
+	if (!runner.selected(load_binary) && !runner.selected(load_text) && !runner.selected(build_bvh)
+		&& !runner.selected(refit_bvh))
+		return;
+
+	Scene scene;
+	for (int m = 0; m < 1024; m++)
+		scene.materials.add(Lambertian(Color::random()));
+	scene.spheres.reserve(count);
+	for (int i = 0; i < count; i++)
+		scene.spheres.add(Vec3::random(-100, 100), Real(random_double(0.05, 0.5)), i % 1024);
+
+	// written next to the working directory and removed again afterwards
+	const std::string binary_path = "Benchmarks_scene.bscene";
+	const std::string text_path = "Benchmarks_scene.scene";
+	if (!save_scene(scene, binary_path) || !save_scene(scene, text_path))
+	{
+		std::clog << "Failed to write the benchmark scenes\n";
+		return;
+	}
+
+	Scene loaded;
+	runner.run(load_binary, count, [&]()
+	{
+		load_scene(binary_path, loaded);
+		sink = sink + loaded.spheres.radius(count - 1);
+	});
+	runner.run(load_text, count, [&]()
+	{
+		load_scene(text_path, loaded);
+		sink = sink + loaded.spheres.radius(count - 1);
+	});
+	runner.run(build_bvh, count, [&]()
+	{
+		FlatBVH bvh(scene.spheres);
+		sink = sink + bvh.bounding_box().x.size();
+	});
+
+	// what an animated frame pays instead of a rebuild: every sphere nudged, then the tree's bounds recomputed
+	if (runner.selected(refit_bvh))
+	{
+		const BenchmarkResult* build = runner.last_result(build_bvh);
+		const double build_seconds = build ? build->seconds / build->ops : 0;
+
+		FlatBVH bvh(scene.spheres);
+		int frame = 0;
+		runner.run(refit_bvh, count, [&]()
+		{
+			Vec3 step(0, (frame++ % 2) ? Real(-0.01) : Real(0.01), 0);
+			for (int i = 0; i < count; i++)
+				scene.spheres.set_sphere(i, scene.spheres.center(i) + step, scene.spheres.radius(i));
+			bvh.refit(scene.spheres);
+			sink = sink + bvh.bounding_box().y.size();
+		});
+		const BenchmarkResult* refit = runner.last_result(refit_bvh);
+		if (build_seconds > 0 && refit)
+			runner.metric("speedup_vs_build", build_seconds / (refit->seconds / refit->ops));
+	}
+
+	std::remove(binary_path.c_str());
+	std::remove(text_path.c_str());
+}
+
+static void scene_builder_benchmarks(BenchmarkRunner& runner)
+{
+	// one world of spheres and instanced clusters of spheres, built either with a make_shared per object into a
+	// HittableList handed to a FlatBVH, or through a SceneBuilder into a PackedScene, ops are objects built or rays traced
+	// builds report the peak resident memory they took, traces the cache misses per ray where the counters can be read
+	for (int count : { 10000, 100000, 1000000 })
+	{
+		const std::string suffix = "/" + std::to_string(count);
+		const std::string construct_names[2] = { "scene_construct/shared_ptr" + suffix, "scene_construct/builder" + suffix };
+		const std::string trace_names[2] = { "scene_trace/shared_ptr" + suffix, "scene_trace/builder" + suffix };
+		bool any_selected = false;
+		for (int way = 0; way < 2; way++)
+			any_selected = any_selected || runner.selected(construct_names[way]) || runner.selected(trace_names[way]);
+		if (!any_selected)
+			continue;
+
+		// spread over a cube that grows with the count, so the density of objects stays the same, every eighth object
+		// is an instance of an 8 sphere cluster
+		struct Placement
+		{
+			Point3 center;
+			Real radius;
+			int material;
+			bool instance;
+		};
+		const double side = 2 * std::cbrt(double(count));
+		std::vector<Placement> placements(count);
+		for (int i = 0; i < count; i++)
+		{
+			placements[i] = { Vec3::random(0, side), Real(random_double(0.2, 0.5)), i % 256, i % 8 == 0 };
+		}
+
+		SphereSet cluster;
+		for (int i = 0; i < 8; i++)
+			cluster.add(Vec3::random(-1, 1), Real(random_double(0.1, 0.3)), i);
+
+		auto build_shared = [&](MaterialTable& materials)
+		{
+			for (int m = 0; m < 256; m++)
+				materials.add(Lambertian(Color(Real(m / 255.0), Real(0.5), Real(0.5))));
+			std::shared_ptr<Hittable> cluster_bvh = std::make_shared<FlatBVH>(cluster);
+
+			HittableList list;
+			for (const Placement& p : placements)
+			{
+				if (p.instance)
+					list.add(std::make_shared<Instance>(cluster_bvh, Transform::translate(p.center) * Transform::scale(p.radius)));
+				else
+					list.add(std::make_shared<Sphere>(p.center, p.radius, p.material));
+			}
+			return std::make_unique<FlatBVH>(list);
+		};
+
+		auto build_packed = [&]()
+		{
+			SceneBuilder builder;
+			for (int m = 0; m < 256; m++)
+				builder.add_material(Lambertian(Color(Real(m / 255.0), Real(0.5), Real(0.5))));
+			const FlatBVH& cluster_bvh = builder.make<FlatBVH>(cluster);
+
+			builder.reserve_spheres(placements.size());
+			for (const Placement& p : placements)
+			{
+				if (p.instance)
+					builder.add<Instance>(cluster_bvh, Transform::translate(p.center) * Transform::scale(p.radius));
+				else
+					builder.add_sphere(p.center, p.radius, p.material);
+			}
+			return std::make_unique<PackedScene>(builder.build());
+		};
+
+		const std::vector<Ray> rays = rays_through_box(AABB(Point3(0, 0, 0), Point3(side, side, side)), NUM_RAYS);
+		CacheMissCounter cache_misses;
+		auto trace = [&](const std::string& name, const Hittable& world)
+		{
+			HitRecord rec;
+			auto trace_all = [&]()
+			{
+				int hits = 0;
+				for (const Ray& r : rays)
+					hits += world.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+				sink = sink + hits;
+			};
+			runner.run(name, NUM_RAYS, trace_all);
+			if (!runner.last_result(name) || !cache_misses.available())
+				return;
+
+			cache_misses.start();
+			trace_all();
+			runner.metric("cache_misses_per_ray", double(cache_misses.stop()) / NUM_RAYS);
+		};
+
+		// each way is timed first, then built once more on its own to measure its peak memory and be traced
+		{
+			runner.run(construct_names[0], count, [&]()
+			{
+				MaterialTable materials;
+				sink = sink + build_shared(materials)->bounding_box().x.size();
+			});
+			const bool recorded = runner.last_result(construct_names[0]) != nullptr;
+
+			reset_peak_resident();
+			double before = resident_bytes();
+			MaterialTable materials;
+			std::unique_ptr<FlatBVH> world = build_shared(materials);
+			if (recorded)
+				runner.metric("peak_resident_bytes", peak_resident_bytes() - before);
+			trace(trace_names[0], *world);
+		}
+		{
+			runner.run(construct_names[1], count, [&]()
+			{
+				sink = sink + build_packed()->world().bounding_box().x.size();
+			});
+			const bool recorded = runner.last_result(construct_names[1]) != nullptr;
+
+			reset_peak_resident();
+			double before = resident_bytes();
+			std::unique_ptr<PackedScene> scene = build_packed();
+			if (recorded)
+				runner.metric("peak_resident_bytes", peak_resident_bytes() - before);
+			trace(trace_names[1], scene->world());
+		}
+	}
+}
+
+static void mesh_benchmarks(BenchmarkRunner& runner)
+{
+	// a unit UV sphere of a million triangles written as OBJ, ops are triangles loaded or built, or rays traced
+	const int rings = 500;
+	const std::string load_name = "mesh_load/obj/1000000";
+	const std::string build_name = "mesh_build/1000000";
+	const std::string hit_name = "mesh_hit/1000000";
+	if (!runner.selected(load_name) && !runner.selected(build_name) && !runner.selected(hit_name))
+		return;
+
+	// written next to the working directory and removed again afterwards
+	const std::string path = "Benchmarks_mesh.obj";
+	{
+		std::ofstream obj(path);
+		auto index = [&](int ring, int segment) { return 2 + (ring - 1) * 2 * rings + segment % (2 * rings); };
+		obj << "v 0 1 0\n";
+		for (int i = 1; i < rings; i++)
+		{
+			for (int j = 0; j < 2 * rings; j++)
+			{
+				double theta = PI * i / rings, phi = PI * j / rings;
+				obj << "v " << std::sin(theta) * std::cos(phi) << " " << std::cos(theta) << " " << std::sin(theta) * std::sin(phi) << "\n";
+			}
+		}
+		obj << "v 0 -1 0\n";
+		for (int j = 0; j < 2 * rings; j++)
+			obj << "f 1 " << index(1, j + 1) << " " << index(1, j) << "\n";
+		for (int i = 1; i < rings - 1; i++)
+		{
+			for (int j = 0; j < 2 * rings; j++)
+				obj << "f " << index(i, j) << " " << index(i, j + 1) << " " << index(i + 1, j + 1) << " " << index(i + 1, j) << "\n";
+		}
+		for (int j = 0; j < 2 * rings; j++)
+			obj << "f " << index(rings - 1, j) << " " << index(rings - 1, j + 1) << " " << 2 + (rings - 1) * 2 * rings << "\n";
+		if (!obj)
+		{
+			std::clog << "Failed to write the benchmark mesh\n";
+			return;
+		}
+	}
+
+	std::vector<Point3> vertices;
+	std::vector<int> indices;
+	load_obj(path, vertices, indices);
+	const long long triangles = indices.size() / 3;
+
+	runner.run(load_name, triangles, [&]()
+	{
+		std::vector<Point3> v;
+		std::vector<int> i;
+		load_obj(path, v, i);
+		sink = sink + double(i.size());
+	});
+	std::remove(path.c_str());
+
+	runner.run(build_name, triangles, [&]()
+	{
+		TriangleMesh mesh(vertices, indices, 0);
+		sink = sink + mesh.bounding_box().x.size();
+	});
+
+	TriangleMesh mesh(vertices, indices, 0);
+	std::vector<Ray> rays;
+	for (int i = 0; i < NUM_RAYS; i++)
+	{
+		Point3 origin = 3 * unit_vector(Vec3::random(-1, 1));
+		rays.push_back(Ray(origin, Real(0.5) * Vec3::random(-1, 1) - origin));
+	}
+	HitRecord rec;
+	runner.run(hit_name, NUM_RAYS, [&]()
+	{
+		int hits = 0;
+		for (const Ray& r : rays)
+			hits += mesh.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+		sink = sink + hits;
+	});
+	if (runner.last_result(hit_name))
+		runner.metric("bytes_per_triangle", double(mesh.memory_bytes()) / mesh.triangle_count());
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			options.filter = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+		{
+			options.min_time = std::atof(argv[++i]);
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--filter <substring>] [--min-time <seconds>]\n";
+			return 1;
+		}
+	}
+
+	BenchmarkRunner runner(options);
+	intersection_benchmarks(runner);
+	instancing_benchmarks(runner);
+	sampling_benchmarks(runner);
+	shading_benchmarks(runner);
+	output_benchmarks(runner);
+	render_benchmarks(runner);
+	light_benchmarks(runner);
+	denoise_benchmarks(runner);
+	scene_benchmarks(runner);
+	scene_builder_benchmarks(runner);
+	mesh_benchmarks(runner);
+
+	runner.write_json(std::cout);
+	return 0;
+}
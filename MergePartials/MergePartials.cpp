@@ -0,0 +1,65 @@
+#include "RTWeekend.h"
+
+#include "ImageWriter.h"
+#include "PartialBuffer.h"
+
+#include <vector>
+
+// adds up the partial buffers of a distributed render and writes the final image, the format follows its extension
+// usage: MergePartials <output image> <partial>...
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: " << argv[0] << " <output image> <partial>...\n";
+		return 1;
+	}
+
+	Framebuffer fb;
+	std::vector<PartialRange> ranges;
+	for (int k = 2; k < argc; k++)
+	{
+		PartialRange range;
+		if (!load_partial(argv[k], fb, range))
+			return 1;
+
+		for (size_t other = 0; other < ranges.size(); other++)
+		{
+			if (range.settings_hash != ranges[other].settings_hash)
+			{
+				std::clog << "Failed to merge " << argv[k] << ": it was rendered with other settings than " << argv[2 + other] << "\n";
+				return 1;
+			}
+			if (ranges_overlap(range, ranges[other]))
+			{
+				std::clog << "Failed to merge " << argv[k] << ": its samples overlap those of " << argv[2 + other] << "\n";
+				return 1;
+			}
+		}
+		ranges.push_back(range);
+	}
+
+	// uncovered pixels stay black, which is almost always a missing share rather than intended
+	long long empty_pixels = 0, total_samples = 0;
+	for (int j = 0; j < fb.height(); j++)
+	{
+		for (int i = 0; i < fb.width(); i++)
+		{
+			empty_pixels += fb.sample_count(i, j) == 0;
+			total_samples += fb.sample_count(i, j);
+		}
+	}
+
+	std::clog << argc - 2 << " partials, " << fb.width() << "x" << fb.height() << ", "
+		<< double(total_samples) / (double(fb.width()) * fb.height()) << " samples per pixel\n";
+	if (empty_pixels > 0)
+		std::clog << "Warning: " << empty_pixels << " pixels have no samples\n";
+
+	if (!make_image_writer(argv[1])->write(fb, argv[1]))
+	{
+		std::clog << "Failed to write " << argv[1] << "\n";
+		return 1;
+	}
+	return 0;
+}
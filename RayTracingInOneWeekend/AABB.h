@@ -5,56 +5,73 @@
 
 #include "RTWeekend.h"
 
-class AABB
+template<typename T>
+class AABBT
 {
 public:
-	Interval x, y, z;
+	IntervalT<T> x, y, z;
 
-	AABB() {}
-	AABB(const Interval& x, const Interval& y, const Interval& z) : x(x), y(y), z(z) {}
-	AABB(const Point3& a, const Point3& b)
+	AABBT() {}
+	AABBT(const IntervalT<T>& x, const IntervalT<T>& y, const IntervalT<T>& z) : x(x), y(y), z(z) {}
+	AABBT(const Vec3T<T>& a, const Vec3T<T>& b)
 	{
-		x = (a[0] <= b[0]) ? Interval(a[0], b[0]) : Interval(b[0], a[0]);
-		x = (a[1] <= b[1]) ? Interval(a[1], b[1]) : Interval(b[1], a[1]);
-		x = (a[2] <= b[2]) ? Interval(a[2], b[2]) : Interval(b[2], a[2]);
+		x = (a[0] <= b[0]) ? IntervalT<T>(a[0], b[0]) : IntervalT<T>(b[0], a[0]);
+		y = (a[1] <= b[1]) ? IntervalT<T>(a[1], b[1]) : IntervalT<T>(b[1], a[1]);
+		z = (a[2] <= b[2]) ? IntervalT<T>(a[2], b[2]) : IntervalT<T>(b[2], a[2]);
 	}
-	AABB(const AABB& box0, const AABB& box1)
+	AABBT(const AABBT& box0, const AABBT& box1)
 	{
-		x = Interval(box0.x, box1.x);
-		y = Interval(box0.y, box1.y);
-		z = Interval(box0.z, box1.z);
+		x = IntervalT<T>(box0.x, box1.x);
+		y = IntervalT<T>(box0.y, box1.y);
+		z = IntervalT<T>(box0.z, box1.z);
 	}
 	
-	const Interval& axis_interval(int n) const
+	const IntervalT<T>& axis_interval(int n) const
 	{
 		if (n == 1) return y;
 		if (n == 2) return z;
 		return x;
 	}
 
-	bool hit(const Ray& r, Interval ray_t) const
+	int longest_axis() const
 	{
-		const Point3& ray_orig = r.origin();
-		const Vec3& ray_dir = r.direction();
+		// returns the index of the longest axis of the bounding box
+		if (x.size() > y.size())
+			return x.size() > z.size() ? 0 : 2;
+		return y.size() > z.size() ? 1 : 2;
+	}
+
+	T surface_area() const
+	{
+		if (x.size() < 0 || y.size() < 0 || z.size() < 0)
+			return 0;
+
+		return 2 * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
+	}
+
+	Vec3T<T> centroid() const
+	{
+		return Vec3T<T>(T(0.5) * (x.min + x.max), T(0.5) * (y.min + y.max), T(0.5) * (z.min + z.max));
+	}
+
+	bool hit(const RayT<T>& r, IntervalT<T> ray_t) const
+	{
+		RT_STAT(box_tests++);
+
+		const Vec3T<T>& ray_orig = r.origin();
+		const Vec3T<T>& ray_inv_dir = r.inverse_direction();
 
 		for (int axis = 0; axis < 3; axis++)
 		{
-			const Interval& ax = axis_interval(axis);
-			const double adinv = 1.0 / ray_dir[axis];
-
-			auto t0 = (ax.min - ray_orig[axis]) * adinv;
-			auto t1 = (ax.max - ray_orig[axis]) * adinv;
-
-			if (t0 < t1)
-			{
-				if (t0 > ray_t.min) ray_t.min = t0;
-				if (t1 < ray_t.max) ray_t.max = t1;
-			}
-			else
-			{
-				if (t1 > ray_t.min) ray_t.min = t1;
-				if (t0 < ray_t.max) ray_t.max = t0;
-			}
+			const IntervalT<T>& ax = axis_interval(axis);
+			const T adinv = ray_inv_dir[axis];
+
+			// the direction sign decides which slab plane is entered first
+			T t0 = ((r.sign(axis) ? ax.max : ax.min) - ray_orig[axis]) * adinv;
+			T t1 = ((r.sign(axis) ? ax.min : ax.max) - ray_orig[axis]) * adinv;
+
+			if (t0 > ray_t.min) ray_t.min = t0;
+			if (t1 < ray_t.max) ray_t.max = t1;
 
 			if (ray_t.max <= ray_t.min)
 				return false;
@@ -64,4 +81,6 @@ public:
 
 };
 
+using AABB = AABBT<Real>;
+
 #endif
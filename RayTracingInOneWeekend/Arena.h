@@ -0,0 +1,105 @@
+#pragma once
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Arena
+{
+public:
+	// monotonic allocator: memory is handed out by bumping a cursor through large blocks and only freed all at once,
+	// when the arena goes away, which also runs the destructors of everything create made, newest first
+	// objects never move, so pointers into the arena stay valid when the arena itself is moved
+	explicit Arena(size_t block_size = 1 << 16) : block_size(block_size) {}
+
+	~Arena() { release(); }
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	Arena(Arena&& other) noexcept
+		: block_size(other.block_size), blocks(std::move(other.blocks)), destructors(std::move(other.destructors)),
+		cursor(other.cursor), left(other.left), used(other.used), reserved(other.reserved)
+	{
+		other.blocks.clear();
+		other.destructors.clear();
+		other.cursor = nullptr;
+		other.left = other.used = other.reserved = 0;
+	}
+
+	void* allocate(size_t size, size_t alignment)
+	{
+		size_t padding = (alignment - uintptr_t(cursor) % alignment) % alignment;
+		if (!cursor || padding + size > left)
+		{
+			// requests larger than a block get a block of their own, the current one keeps serving small ones
+			size_t new_size = std::max(block_size, size + alignment);
+			blocks.emplace_back(new unsigned char[new_size]);
+			reserved += new_size;
+			unsigned char* block = blocks.back().get();
+			if (size + alignment > block_size)
+			{
+				used += size;
+				return block + (alignment - uintptr_t(block) % alignment) % alignment;
+			}
+
+			cursor = block;
+			left = new_size;
+			padding = (alignment - uintptr_t(cursor) % alignment) % alignment;
+		}
+
+		void* p = cursor + padding;
+		cursor += padding + size;
+		left -= padding + size;
+		used += size;
+		return p;
+	}
+
+	template<typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+			destructors.push_back({ &destroy<T>, object });
+		return object;
+	}
+
+	size_t bytes_used() const { return used; }
+	size_t bytes_reserved() const { return reserved; }
+
+private:
+	struct Destructor
+	{
+		void (*destroy)(void*);
+		void* object;
+	};
+
+	size_t block_size;
+	std::vector<std::unique_ptr<unsigned char[]>> blocks;
+	std::vector<Destructor> destructors;
+	unsigned char* cursor = nullptr;		// next free byte of the newest small-object block
+	size_t left = 0;
+	size_t used = 0;
+	size_t reserved = 0;
+
+	template<typename T>
+	static void destroy(void* object) { static_cast<T*>(object)->~T(); }
+
+	void release()
+	{
+		for (size_t i = destructors.size(); i > 0; i--)
+			destructors[i - 1].destroy(destructors[i - 1].object);
+		destructors.clear();
+		blocks.clear();
+	}
+};
+
+#endif
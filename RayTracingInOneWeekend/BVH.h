@@ -0,0 +1,261 @@
+#pragma once
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "Hittable.h"
+#include "HittableList.h"
+
+#include <algorithm>
+#include <vector>
+
+struct BVHPrimitive
+{
+	AABB bbox;
+	Point3 centroid;
+	int index;		// index of the primitive in the caller's own storage
+};
+
+struct BVHBuildNode
+{
+	AABB bbox;
+	int left = -1;
+	int right = -1;
+	int first = 0;		// first primitive of a leaf, as an offset into the reordered primitive list
+	int count = 0;		// number of primitives in a leaf
+	int axis = 0;		// axis the node was split along
+
+	bool is_leaf() const { return left < 0; }
+};
+
+class BVHBuilder
+{
+public:
+	static const int NUM_BINS = 16;
+
+	int max_leaf_size = 4;
+	double traversal_cost = 1.0;		// cost of visiting a node, relative to a single primitive intersection
+
+	std::vector<BVHBuildNode> nodes;
+
+	int build(std::vector<BVHPrimitive>& prims)
+	{
+		// reorders prims so that every leaf references a contiguous range, returns the root node index
+		nodes.clear();
+		nodes.reserve(prims.empty() ? 1 : 2 * prims.size());
+		return build_recursive(prims, 0, int(prims.size()));
+	}
+
+private:
+	struct Bin
+	{
+		AABB bbox;
+		int count = 0;
+	};
+
+	int make_leaf(const AABB& bbox, int start, int end)
+	{
+		BVHBuildNode node;
+		node.bbox = bbox;
+		node.first = start;
+		node.count = end - start;
+		nodes.push_back(node);
+		return int(nodes.size()) - 1;
+	}
+
+	static int bin_index(const BVHPrimitive& prim, int axis, const Interval& centroid_range)
+	{
+		int b = int(NUM_BINS * (prim.centroid[axis] - centroid_range.min) / centroid_range.size());
+		return b < NUM_BINS - 1 ? b : NUM_BINS - 1;
+	}
+
+	int build_recursive(std::vector<BVHPrimitive>& prims, int start, int end)
+	{
+		AABB bbox;
+		AABB centroid_bounds;
+		for (int i = start; i < end; i++)
+		{
+			bbox = AABB(bbox, prims[i].bbox);
+			centroid_bounds = AABB(centroid_bounds, AABB(prims[i].centroid, prims[i].centroid));
+		}
+
+		const int count = end - start;
+		if (count <= 1)
+			return make_leaf(bbox, start, end);
+
+		// binned surface area heuristic, evaluated along every axis with a non-degenerate centroid spread
+		double best_cost = INF;
+		int best_axis = -1;
+		int best_split = 0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const Interval& centroid_range = centroid_bounds.axis_interval(axis);
+			if (centroid_range.size() <= 0)
+				continue;
+
+			Bin bins[NUM_BINS];
+			for (int i = start; i < end; i++)
+			{
+				Bin& bin = bins[bin_index(prims[i], axis, centroid_range)];
+				bin.bbox = AABB(bin.bbox, prims[i].bbox);
+				bin.count++;
+			}
+
+			// sweep from the right to find the cost of every right hand side, then from the left to combine them
+			double right_area[NUM_BINS - 1];
+			int right_count[NUM_BINS - 1];
+			AABB right_box;
+			int right_total = 0;
+			for (int b = NUM_BINS - 1; b > 0; b--)
+			{
+				right_box = AABB(right_box, bins[b].bbox);
+				right_total += bins[b].count;
+				right_area[b - 1] = right_box.surface_area();
+				right_count[b - 1] = right_total;
+			}
+
+			AABB left_box;
+			int left_total = 0;
+			for (int b = 0; b < NUM_BINS - 1; b++)
+			{
+				left_box = AABB(left_box, bins[b].bbox);
+				left_total += bins[b].count;
+
+				if (left_total == 0 || right_count[b] == 0)
+					continue;
+
+				double cost = left_total * left_box.surface_area() + right_count[b] * right_area[b];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = axis;
+					best_split = b;
+				}
+			}
+		}
+
+		double parent_area = bbox.surface_area();
+		double split_cost = traversal_cost + (parent_area > 0 ? best_cost / parent_area : 0);
+		if (count <= max_leaf_size && (best_axis < 0 || count <= split_cost))
+			return make_leaf(bbox, start, end);
+
+		int mid;
+		int axis;
+		if (best_axis >= 0)
+		{
+			axis = best_axis;
+			const Interval& centroid_range = centroid_bounds.axis_interval(axis);
+			auto middle = std::partition(prims.begin() + start, prims.begin() + end,
+				[&](const BVHPrimitive& prim) { return bin_index(prim, axis, centroid_range) <= best_split; });
+			mid = int(middle - prims.begin());
+		}
+		else
+		{
+			// all centroids coincide, so any split is as good as another
+			axis = bbox.longest_axis();
+			mid = start + count / 2;
+		}
+
+		int node_index = int(nodes.size());
+		nodes.push_back(BVHBuildNode());
+
+		int left = build_recursive(prims, start, mid);
+		int right = build_recursive(prims, mid, end);
+
+		BVHBuildNode& node = nodes[node_index];
+		node.bbox = bbox;
+		node.left = left;
+		node.right = right;
+		node.axis = axis;
+		return node_index;
+	}
+};
+
+class BVHNode : public Hittable
+{
+public:
+	BVHNode(const HittableList& list)
+	{
+		std::vector<BVHPrimitive> prims;
+		prims.reserve(list.objects.size());
+		for (int i = 0; i < int(list.objects.size()); i++)
+		{
+			AABB box = list.objects[i]->bounding_box();
+			prims.push_back({ box, box.centroid(), i });
+		}
+
+		BVHBuilder builder;
+		int root = builder.build(prims);
+		init(builder.nodes, root, prims, list.objects);
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override
+	{
+		RT_STAT(bvh_nodes++);
+
+		if (!bbox.hit(r, ray_t))
+			return false;
+
+		// visit the child nearest to the ray origin first so the far child can be culled by the closer hit
+		const Hittable* first = left.get();
+		const Hittable* second = right.get();
+		if (second && r.direction()[axis] < 0)
+			std::swap(first, second);
+
+		bool hit_first = first->hit(r, ray_t, rec);
+		bool hit_second = second && second->hit(r, Interval(ray_t.min, hit_first ? rec.t : ray_t.max), rec);
+
+		return hit_first || hit_second;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+private:
+	std::shared_ptr<Hittable> left;
+	std::shared_ptr<Hittable> right;
+	AABB bbox;
+	int axis = 0;
+
+	BVHNode(const std::vector<BVHBuildNode>& nodes, int index, const std::vector<BVHPrimitive>& prims,
+		const std::vector<std::shared_ptr<Hittable>>& objects)
+	{
+		init(nodes, index, prims, objects);
+	}
+
+	void init(const std::vector<BVHBuildNode>& nodes, int index, const std::vector<BVHPrimitive>& prims,
+		const std::vector<std::shared_ptr<Hittable>>& objects)
+	{
+		const BVHBuildNode& node = nodes[index];
+		bbox = node.bbox;
+		axis = node.axis;
+
+		if (node.is_leaf())
+		{
+			// only reached when the whole scene fits in a single leaf
+			left = make_child(nodes, index, prims, objects);
+			return;
+		}
+
+		left = make_child(nodes, node.left, prims, objects);
+		right = make_child(nodes, node.right, prims, objects);
+	}
+
+	static std::shared_ptr<Hittable> make_child(const std::vector<BVHBuildNode>& nodes, int index,
+		const std::vector<BVHPrimitive>& prims, const std::vector<std::shared_ptr<Hittable>>& objects)
+	{
+		const BVHBuildNode& node = nodes[index];
+		if (!node.is_leaf())
+			return std::shared_ptr<BVHNode>(new BVHNode(nodes, index, prims, objects));
+
+		if (node.count == 1)
+			return objects[prims[node.first].index];
+
+		auto leaf = std::make_shared<HittableList>();
+		for (int i = node.first; i < node.first + node.count; i++)
+			leaf->add(objects[prims[i].index]);
+		return leaf;
+	}
+};
+
+#endif
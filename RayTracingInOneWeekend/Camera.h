@@ -4,8 +4,32 @@
 #define CAMERA_H
 
 #include <thread>
+#include <chrono>
+#include <fstream>
 #include <future>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+#include "CheckpointWriter.h"
+#include "Denoiser.h"
+#include "Features.h"
+#include "Framebuffer.h"
+#include "ImageWriter.h"
+#include "Light.h"
+#include "MaterialTable.h"
+#include "Sky.h"
+#include "TileScheduler.h"
+#include "WavefrontIntegrator.h"
+
+// Recursive follows each sample's path to its end through ray_color,
+// Wavefront advances a batch of paths together one bounce at a time
+enum class Integrator
+{
+	Recursive,
+	Wavefront
+};
 
 class Camera
 {
@@ -23,43 +47,354 @@ public:
 	double defocus_angle = 0.0;		// variation angle of rays through each pixel
 	double focus_dist = 10.0;		// distance from camera lookfrom point to plane of perfect focus
 
-	Camera(const Hittable& world) : world(world) {}
+	int num_threads = 0;			// number of render workers, 0 uses every hardware thread
+	int tile_size = 32;				// width and height in pixels of the tiles handed out to workers
+
+	// image file to write, the format follows the extension (.png, .pfm, otherwise binary .ppm)
+	// an empty path streams plain text P3 to stdout instead
+	std::string output_path;
+
+	// adaptive sampling renders in passes and stops sampling a pixel once the 95% confidence interval of its mean
+	// is narrower than adaptive_threshold on the displayed (gamma 2) scale, samples_per_pixel becomes the upper bound
+	bool adaptive_sampling = false;
+	int min_samples = 16;
+	int adaptive_pass_samples = 16;
+	double adaptive_threshold = 0.01;
+	std::string sample_heatmap_path;		// optional image of the samples each pixel received
+
+	// trace the camera rays of blocks of adjacent pixels together as SIMD packets, four pixels wide and packet_size / 4
+	// rows high, with packet_size a multiple of 4 up to 16
+	// reflections off Metal with fuzz up to packet_reflection_fuzz stay about as coherent and are traced as a second
+	// packet, the other secondary bounces are incoherent and follow single rays
+	bool packet_tracing = false;
+	int packet_size = 4;
+	double packet_reflection_fuzz = 0.1;
+
+	// Russian roulette ends paths early with a probability that grows as their throughput falls, reweighting the
+	// survivors so the image stays unbiased, the first roulette_min_depth bounces are always taken
+	bool russian_roulette = false;
+	int roulette_min_depth = 5;
+
+	Integrator integrator = Integrator::Recursive;
+	int wavefront_batch_size = 1 << 16;		// paths in flight per worker
+
+	SamplerType sampler = SamplerType::Sobol;		// where the numbers of every sample come from, see Sampler.h
+
+	// next-event estimation sends a shadow ray towards one of the lights from every diffuse hit, and weighs the light
+	// it finds against the light the scattered ray finds by multiple importance sampling (power heuristic), without it
+	// paths only find lights by chance
+	bool next_event_estimation = true;
+	LightList lights;		// the scene's emissive spheres, empty when the sky is the only light
+
+	// one share of a distributed render: only rows [first_row, end_row) and samples [first_sample, end_sample) of each
+	// pixel are rendered, an end of 0 stands for the image height or samples_per_pixel, as every sample seeds its own
+	// random numbers the shares of separate processes together hold exactly the samples of a whole render
+	int first_row = 0;
+	int end_row = 0;
+	int first_sample = 0;
+	int end_sample = 0;
+
+	// with a checkpoint path the accumulated samples are saved as a partial buffer every checkpoint_seconds, between
+	// passes of checkpoint_pass_samples, and once more at the end, a background thread writes them while rendering goes on
+	// resume_path continues from such a checkpoint with the samples after those it holds, up to samples_per_pixel, and a
+	// checkpoint that is missing or was rendered with other settings fails the render rather than starting it afresh
+	std::string checkpoint_path;
+	double checkpoint_seconds = 60.0;
+	int checkpoint_pass_samples = 8;
+	std::string resume_path;
+
+	// identifies the scene for settings_hash, e.g. scene_content_hash of a Scene, so that shares and checkpoints of
+	// different or edited scenes seen through the same camera are never mixed, 0 when unknown
+	uint32_t scene_hash = 0;
+
+	// progressive rendering samples the whole image in passes, each as many samples as all the ones before it, until
+	// time_budget seconds are up or the mean noise of the image, on the scale of adaptive_threshold, is below
+	// target_noise (0 turns either off), samples_per_pixel becomes the upper bound and adaptive_sampling is ignored
+	// the last pass is cut short to end within the budget, and every preview_seconds the image so far is written to
+	// output_path, by a background thread
+	bool progressive = false;
+	double time_budget = 0.0;
+	double target_noise = 0.0;
+	double preview_seconds = 10.0;
+
+	// denoise filters the finished image with an edge-avoiding wavelet filter guided by first-hit albedo and normals,
+	// which are recorded with every sample when denoising, or when albedo_path or normal_path asks for them as images
+	bool denoise = false;
+	std::string albedo_path;
+	std::string normal_path;
+
+	bool show_progress = true;
+
+	// per-worker ray, intersection and path statistics, printed to clog and/or written as JSON after the render
+	bool print_stats = false;
+	std::string stats_json_path;
+
+	Camera(const Hittable& world, const MaterialTable& materials) : world(world), materials(materials) {}
+
+	bool render()
+	{
+		// false when the render could not resume or an image or checkpoint could not be written, which has been logged
+		// a render whose checkpoints failed still writes its image, one that could not resume has nothing to write
+		bool written = render_framebuffer();
+		if (!written && reached_samples == 0)
+			return false;
+
+		Framebuffer denoised;
+		if (denoise)
+		{
+			auto start = std::chrono::steady_clock::now();
+			Denoiser denoiser;
+			denoiser.num_threads = num_threads;
+			denoised = denoiser.run(fb);
+			denoise_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (show_progress)
+				std::clog << "\rDenoised in " << denoise_seconds << " s\n";
+		}
+		const Framebuffer& image = denoise ? denoised : fb;
+
+		if (output_path.empty())
+		{
+			PPMTextWriter().write(image, std::cout);
+			written = bool(std::cout) && written;
+		}
+		else if (!make_image_writer(output_path)->write(image, output_path))
+		{
+			std::clog << "\nFailed to write " << output_path << "\n";
+			written = false;
+		}
+
+		if (!sample_heatmap_path.empty())
+			written = write_sample_heatmap() && written;
+		if (!albedo_path.empty() || !normal_path.empty())
+			written = write_features() && written;
+
+		if (show_progress)
+			std::clog << "\rDone.                  \n";
+		return written;
+	}
 
-	void render()
+	bool render_framebuffer()
 	{
+		// renders into framebuffer() without writing any image, false when a checkpoint could not be written, or when
+		// resume_path could not be resumed from, then nothing is rendered so that a fresh render never overwrites the
+		// checkpoint it was asked to continue, and samples_reached() is 0
 		initialise();
 
-		// -1 == not yet handled by any thread, any number other than -1 signifies which thread is handling the line
-		lines_rendered.resize(image_height, -1);
-		lines_as_string.resize(image_height);
+		fb.resize(image_width, image_height, denoise || !albedo_path.empty() || !normal_path.empty());
+		worker_stats.assign(worker_count(), RenderStats());
+		auto start = std::chrono::steady_clock::now();
 
-		std::cout << "P3\n" << image_width << " " << image_height << "\n255\n";
+		PartialRange done = { first_row, row_limit(), first_sample, first_sample, settings_hash() };
+		if (!resume_path.empty() && !resume(done))
+		{
+			fb.resize(image_width, image_height, fb.has_features());
+			reached_samples = 0;
+			render_seconds = 0;
+			return false;
+		}
 
-		const int numOfThreads = std::thread::hardware_concurrency();
-		std::vector<std::future<void>> futures;
+		std::unique_ptr<CheckpointWriter> checkpoints;
+		if (!checkpoint_path.empty())
+			checkpoints = std::make_unique<CheckpointWriter>(checkpoint_path);
+		auto last_checkpoint = start;
+
+		auto pass_done = [&](int sample_end, bool last)
+		{
+			// the framebuffer is only consistent between passes, when no worker is writing to it
+			done.end_sample = sample_end;
+			auto now = std::chrono::steady_clock::now();
+			if (checkpoints && (last || std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_seconds))
+			{
+				checkpoints->submit(fb, done);
+				last_checkpoint = now;
+			}
+		};
+
+		const int sample_limit = end_sample > 0 ? std::min(end_sample, samples_per_pixel) : samples_per_pixel;
+		if (progressive)
+		{
+			std::unique_ptr<CheckpointWriter> previews;
+			if (!output_path.empty())
+			{
+				// the format follows output_path, not the name of the temporary file written first
+				const std::string path = output_path;
+				previews = std::make_unique<CheckpointWriter>(path,
+					[path](const Framebuffer& image, const PartialRange&, const std::string& temp_path)
+					{
+						return make_image_writer(path)->write(image, temp_path);
+					});
+			}
+			auto last_preview = start;
+
+			// a pass's time per sample predicts the next one's, which is cut to as many samples as fit in the budget,
+			// passes that end short of a doubling never change which samples a pixel gets, only when they are taken
+			double pass_sample_seconds = 0;
+			reached_noise = INF;
+			int sample_begin = done.end_sample;
+			while (sample_begin < sample_limit)
+			{
+				int sample_end = std::min(sample_begin + std::max(sample_begin - first_sample, 1), sample_limit);
+				auto pass_start = std::chrono::steady_clock::now();
+				if (time_budget > 0 && pass_sample_seconds > 0)
+				{
+					double seconds_left = time_budget - std::chrono::duration<double>(pass_start - start).count();
+					double affordable = seconds_left / pass_sample_seconds;
+					if (affordable < 1)
+						break;
+					if (affordable < sample_end - sample_begin)
+						sample_end = sample_begin + int(affordable);
+				}
+
+				render_pass(sample_begin, sample_end);
+				auto now = std::chrono::steady_clock::now();
+				pass_sample_seconds = std::chrono::duration<double>(now - pass_start).count() / (sample_end - sample_begin);
+				if (target_noise > 0)
+					reached_noise = image_noise();
+
+				pass_done(sample_end, sample_end == sample_limit);
+				if (previews && sample_end < sample_limit
+					&& std::chrono::duration<double>(now - last_preview).count() >= preview_seconds)
+				{
+					previews->submit(fb, done);
+					last_preview = now;
+				}
+				if (show_progress)
+					std::clog << "\rSamples " << sample_end << " after " << std::chrono::duration<double>(now - start).count()
+						<< " s                  " << std::flush;
+
+				sample_begin = sample_end;
+				if (reached_noise < target_noise)
+					break;
+			}
 
-		for (int i = 0; i < numOfThreads; ++i)
+			// stopping early ends the render before its last pass
+			if (checkpoints && sample_begin < sample_limit)
+				checkpoints->submit(fb, done);
+
+			// render() writes the final image, which must not race a preview still being written
+			if (previews)
+				previews->finish();
+			if (target_noise <= 0)
+				reached_noise = image_noise();
+			if (show_progress)
+				std::clog << "\rProgressive render reached " << done.end_sample - done.first_sample
+					<< " samples per pixel, mean noise " << reached_noise << "          \n";
+		}
+		else if (!adaptive_sampling)
 		{
-			futures.push_back(std::async(std::launch::async, &Camera::render_next_line, this, i));
+			// without checkpoints all samples are taken in one pass
+			const int pass_samples = checkpoints ? std::max(checkpoint_pass_samples, 1) : std::max(sample_limit, 1);
+			for (int sample_begin = done.end_sample; sample_begin < sample_limit; sample_begin += pass_samples)
+			{
+				int sample_end = std::min(sample_begin + pass_samples, sample_limit);
+				render_pass(sample_begin, sample_end);
+				pass_done(sample_end, sample_end == sample_limit);
+			}
 		}
+		else
+		{
+			pixel_active.assign(size_t(image_width) * image_height, 1);
+			active_pixels = image_width * (row_limit() - first_row);
 
-		for (auto& future : futures)
+			// pixels of a resumed render that converged before the checkpoint stay finished
+			if (done.end_sample > done.first_sample)
+			{
+				for (int j = first_row; j < row_limit(); j++)
+				{
+					for (int i = 0; i < image_width; i++)
+					{
+						if (pixel_converged(i, j))
+						{
+							pixel_active[size_t(j) * image_width + i] = 0;
+							active_pixels--;
+						}
+					}
+				}
+			}
+
+			// a resumed render carries on with the passes the uninterrupted one would have taken
+			int sample_begin = done.end_sample;
+			int sample_end = first_sample + std::max(min_samples, 2);
+			if (sample_begin >= sample_end)
+				sample_end = sample_begin + std::max(adaptive_pass_samples, 1);
+			sample_end = std::min(sample_end, sample_limit);
+			while (sample_begin < sample_limit && active_pixels > 0)
+			{
+				render_pass(sample_begin, sample_end);
+				pass_done(sample_end, sample_end == sample_limit);
+
+				sample_begin = sample_end;
+				sample_end = std::min(sample_end + std::max(adaptive_pass_samples, 1), sample_limit);
+			}
+
+			// converging early ends the render before its last pass
+			if (checkpoints && sample_begin < sample_limit)
+				checkpoints->submit(fb, done);
+
+			pixel_active.clear();
+		}
+
+		bool checkpointed = true;
+		if (checkpoints)
+			checkpointed = checkpoints->finish();
+
+		reached_samples = done.end_sample - done.first_sample;
+		render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (print_stats)
 		{
-			future.get();
+			std::clog << "\n";
+			print_render_stats(std::clog, worker_stats, render_seconds);
 		}
 
-		for (const std::string& s : lines_as_string)
+		if (!stats_json_path.empty())
 		{
-			std::cout << s;
+			std::ofstream file(stats_json_path);
+			write_render_stats_json(file, worker_stats, render_seconds);
+			if (!file)
+				std::clog << "\nFailed to write " << stats_json_path << "\n";
 		}
+		return checkpointed;
+	}
 
-		std::clog << "\rDone.                  \n";
+	const Framebuffer& framebuffer() const { return fb; }
+
+	uint32_t settings_hash() const
+	{
+		// FNV-1a over everything that decides what a sample of a pixel is, the scene included through scene_hash, so
+		// samples of different renders are never mixed
+		// the stratified and blue-noise samplers lay their samples out for samples_per_pixel, so it counts for them
+		const bool layout_per_spp = sampler == SamplerType::Stratified || sampler == SamplerType::BlueNoise;
+		const double settings[] = {
+			aspect_ratio, double(image_width), double(max_depth), vfov,
+			lookfrom.x(), lookfrom.y(), lookfrom.z(), lookat.x(), lookat.y(), lookat.z(), vup.x(), vup.y(), vup.z(),
+			defocus_angle, focus_dist, double(russian_roulette), double(russian_roulette ? roulette_min_depth : 0),
+			double(sampler), double(next_event_estimation), double(layout_per_spp ? samples_per_pixel : 0),
+			double(scene_hash)
+		};
+		return fnv1a(settings, sizeof(settings));
+	}
+
+	// statistics of the last render, one entry per worker
+	const std::vector<RenderStats>& render_stats() const { return worker_stats; }
+	double render_time() const { return render_seconds; }
+	double denoise_time() const { return denoise_seconds; }
+
+	// samples per pixel the last render took, and for progressive ones the mean noise it reached
+	int samples_reached() const { return reached_samples; }
+	double noise_reached() const { return reached_noise; }
+
+	Ray camera_ray(int i, int j, int sample)
+	{
+		// the camera ray of a sample of pixel i, j, exactly as a render traces it, e.g. to benchmark coherent rays
+		initialise();
+		start_sample(sampler, i, j, image_width, image_height, sample, samples_per_pixel);
+		return get_ray(i, j);
 	}
 
 private:
 	
 	int image_height;
-	double pixel_samples_scale;
 	Vec3 pixel_delta_u;
 	Vec3 pixel_delta_v;
 	Point3 camera_center;
@@ -68,19 +403,24 @@ private:
 	Vec3 defocus_disk_u;
 	Vec3 defocus_disk_v;
 	const Hittable& world;
+	const MaterialTable& materials;
+
+	Framebuffer fb;
+	std::mutex progress_mtx;
 
-	int lines_left;
-	std::vector<int> lines_rendered;
-	std::vector<std::string> lines_as_string;
-	std::mutex mtx;
+	std::vector<unsigned char> pixel_active;		// adaptive sampling only, pixels that still need samples
+	std::atomic<int> active_pixels;
+
+	std::vector<RenderStats> worker_stats;		// each worker only ever adds to its own entry
+	double render_seconds = 0;
+	double denoise_seconds = 0;
+	int reached_samples = 0;
+	double reached_noise = 0;
 
 	void initialise()
 	{		
 		image_height = int(image_width / aspect_ratio);
 		image_height = (image_height < 1) ? 1 : image_height;
-		lines_left = image_height;
-
-		pixel_samples_scale = 1.0 / samples_per_pixel;
 		
 		camera_center = lookfrom;
 		
@@ -111,6 +451,8 @@ private:
 	Ray get_ray(int i, int j) const
 	{
 		// construct a ray going from the defocus disk onto a randomly sampled point around a pixel at i, j
+		RT_STAT(camera_rays++);
+
 		Vec3 offset = sample_square();
 		Vec3 pixel_sample = start_pixel_loc + ((i + offset.x()) * pixel_delta_u) + ((j + offset.y()) * pixel_delta_v);
 
@@ -123,80 +465,555 @@ private:
 	Vec3 sample_square() const
 	{
 		// returns a vector to a random point inside the unit square
-		return Vec3(random_double() - 0.5, random_double() - 0.5, 0);
+		Sample2D s = sample_2d();
+		return Vec3(Real(s.u - 0.5), Real(s.v - 0.5), 0);
 	}
 
 	Point3 defocus_disk_sample() const
 	{
 		// returns a random point on the camera defocus disk
-		Vec3 p = random_in_unit_disk();
+		Vec3 p = sample_unit_disk();
 		return camera_center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 	}
 
-	Color ray_color(const Ray& r, int depth, const Hittable& world) const
+	Color ray_color(const Ray& r, int depth, const Hittable& world, const Color& throughput = Color(1, 1, 1),
+		SampleFeatures* features = nullptr, Real scatter_pdf = 0) const
 	{
 		if (depth <= 0)
+		{
+			RT_STAT(end_path(PathEnd::DepthCap, max_depth));
 			return Color(0, 0, 0);
+		}
 		
+		RT_STAT(rays++);
 		HitRecord rec;
-		if (world.hit(r, Interval(0.001, INF), rec))
+		bool hit = world.hit(r, Interval(Epsilon<Real>::ray_t_min(), Real(INF)), rec);
+		return shade(r, hit, rec, depth, world, throughput, features, scatter_pdf);
+	}
+
+	Color shade(const Ray& r, bool hit, const HitRecord& rec, int depth, const Hittable& world,
+		const Color& throughput = Color(1, 1, 1), SampleFeatures* features = nullptr, Real scatter_pdf = 0) const
+	{
+		// the colour carried back along r, given the result of intersecting it with the world
+		// throughput is the product of the (roulette weighted) attenuations between the camera and r
+		// features, only passed for camera rays, receives what r first sees
+		// scatter_pdf is the density r was scattered with where next-event estimation also sampled the lights, 0 elsewhere
+		if (features)
+			*features = first_hit_features(r, hit, rec, materials);
+
+		if (hit)
 		{
-			Ray scattered;
-			Color attenuation;
-			if (rec.mat->scatter(r, rec, attenuation, scattered))
+			const Material& mat = materials[rec.material_id];
+			if (mat.emits())
 			{
-				return attenuation * ray_color(scattered, depth - 1, world);
+				RT_STAT(end_path(PathEnd::Light, max_depth - depth + 1));
+				return scattered_light_weight(lights, r, scatter_pdf) * mat.emitted(rec);
 			}
-			
+
+			Bounce bounce;
+			if (!scatter_hit(r, rec, depth, world, throughput, bounce))
+				return bounce.direct;
+
+			return bounce.direct + bounce.attenuation
+				* ray_color(bounce.scattered, depth - 1, world, throughput * bounce.attenuation, nullptr, bounce.pdf);
+		}
+
+		RT_STAT(end_path(PathEnd::Miss, max_depth - depth + 1));
+		return sky_color(r);
+	}
+
+	struct Bounce
+	{
+		Color direct;			// light gathered at the hit itself by next-event estimation
+		Color attenuation;		// of the scattered ray, roulette weight included
+		Ray scattered;
+		Real pdf;				// the scatter_pdf to follow scattered with
+	};
+
+	bool scatter_hit(const Ray& r, const HitRecord& rec, int depth, const Hittable& world, const Color& throughput,
+		Bounce& bounce) const
+	{
+		// what shade does at a hit on a surface that does not emit, up to following the scattered ray
+		// false when the path ends there, carrying only bounce.direct
+		const Material& mat = materials[rec.material_id];
+		bounce.direct = Color(0, 0, 0);
+		start_bounce(max_depth - depth);
+		if (!mat.scatter(r, rec, bounce.attenuation, bounce.scattered))
+		{
+			RT_STAT(end_path(PathEnd::Absorbed, max_depth - depth + 1));
+			return false;
+		}
+
+		// the light draws follow the scatter draws, the roulette draw comes last, as in WavefrontIntegrator
+		bounce.pdf = 0;
+		if (samples_lights(mat, depth))
+		{
+			bounce.direct = direct_light(rec, mat, max_depth - depth, world);
+			bounce.pdf = lambertian_pdf(rec.normal, bounce.scattered.direction());
+		}
+
+		if (russian_roulette && max_depth - depth + 1 >= roulette_min_depth)
+		{
+			double survival = roulette_survival(throughput * bounce.attenuation);
+			if (roulette_sample(max_depth - depth) >= survival)
+			{
+				RT_STAT(end_path(PathEnd::Roulette, max_depth - depth + 1));
+				return false;
+			}
+			bounce.attenuation = bounce.attenuation / Real(survival);
+		}
+		return true;
+	}
+
+	bool samples_lights(const Material& mat, int depth) const
+	{
+		// only diffuse surfaces, the scatter density of Metal and Dielectric is (nearly) a delta no light sample can hit
+		// and not on the last bounce, whose scattered ray is cut off, so a light is never found a bounce later than
+		// max_depth allows a path without next-event estimation
+		return next_event_estimation && !lights.empty() && mat.type() == MaterialType::Lambertian && depth > 1;
+	}
+
+	Color direct_light(const HitRecord& rec, const Material& mat, int bounce, const Hittable& world) const
+	{
+		// light reaching rec.p along a shadow ray, whatever the ray hits first is what it sees, another light included
+		Ray shadow_ray;
+		Real distance;
+		Color weight;
+		if (!sample_light_ray(lights, rec, mat, bounce, shadow_ray, distance, weight))
+			return Color(0, 0, 0);
+
+		RT_STAT(rays++);
+		RT_STAT(shadow_rays++);
+		HitRecord light_rec;
+		if (!world.hit(shadow_ray, Interval(Epsilon<Real>::ray_t_min(), distance), light_rec))
 			return Color(0, 0, 0);
+		return weight * materials[light_rec.material_id].emitted(light_rec);
+	}
+
+	int row_limit() const { return end_row > 0 ? std::min(end_row, image_height) : image_height; }
+
+	bool resume(PartialRange& done)
+	{
+		// adds the checkpoint's samples to the framebuffer and moves done past them, on failure the framebuffer may hold
+		// part of the checkpoint and has to be cleared
+		PartialRange checkpoint;
+		if (!load_partial(resume_path, fb, checkpoint))
+			return false;
+
+		if (checkpoint.settings_hash != done.settings_hash || checkpoint.first_row != done.first_row
+			|| checkpoint.end_row != done.end_row)
+		{
+			std::clog << "Failed to resume from " << resume_path << ": it was rendered with other settings\n";
+			return false;
 		}
 
-		Vec3 unit_dir = unit_vector(r.direction());
-		double a = 0.5 * (unit_dir.y() + 1.0);
-		return (1.0 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0);
+		done.first_sample = checkpoint.first_sample;
+		done.end_sample = checkpoint.end_sample;
+		if (show_progress)
+			std::clog << "Resuming after sample " << done.end_sample << "\n";
+		return true;
 	}
 
-	void render_next_line(int id)
-	{		
-		std::unique_lock<std::mutex> lock(mtx);
-		
-		bool found_empty_line = false;
-		for (int j = 0; j < image_height; j++)
+	int worker_count() const
+	{
+		int num_workers = num_threads > 0 ? num_threads : int(std::thread::hardware_concurrency());
+		return num_workers < 1 ? 1 : num_workers;
+	}
+
+	void render_pass(int sample_begin, int sample_end)
+	{
+		int num_workers = worker_count();
+
+		TileScheduler scheduler(image_width, row_limit(), tile_size, num_workers, first_row);
+		std::vector<std::future<void>> futures;
+
+		for (int i = 0; i < num_workers; ++i)
+		{
+			futures.push_back(std::async(std::launch::async, &Camera::render_tiles, this, i, std::ref(scheduler),
+				sample_begin, sample_end));
+		}
+
+		for (auto& future : futures)
+		{
+			future.get();
+		}
+	}
+
+	void render_tiles(int worker, TileScheduler& scheduler, int sample_begin, int sample_end)
+	{
+		WavefrontIntegrator wavefront(world, materials, lights, max_depth);
+		wavefront.russian_roulette = russian_roulette;
+		wavefront.roulette_min_depth = roulette_min_depth;
+		wavefront.next_event_estimation = next_event_estimation;
+		wavefront.collect_features = fb.has_features();
+
+		thread_stats() = RenderStats();
+		auto start = std::chrono::steady_clock::now();
+
+		Tile tile;
+		while (scheduler.next_tile(worker, tile))
+		{
+			if (integrator == Integrator::Wavefront)
+			{
+				render_tile_wavefront(tile, sample_begin, sample_end, wavefront);
+			}
+			else if (packet_tracing)
+			{
+				const int rows = packet_rows();
+				for (int j = tile.y0; j < tile.y1; j += rows)
+				{
+					for (int i = tile.x0; i < tile.x1; i += RayPacket::GROUP)
+					{
+						render_block_packet(i, j, std::min(RayPacket::GROUP, tile.x1 - i), std::min(rows, tile.y1 - j),
+							sample_begin, sample_end);
+					}
+				}
+			}
+			else
+			{
+				for (int j = tile.y0; j < tile.y1; j++)
+				{
+					for (int i = tile.x0; i < tile.x1; i++)
+						render_pixel(i, j, sample_begin, sample_end);
+				}
+			}
+
+			int tiles_left = scheduler.tile_done();
+
+			// progress is best effort, a worker never waits for another one to finish printing
+			if (show_progress && progress_mtx.try_lock())
+			{
+				if (pixel_active.empty())
+					std::clog << "\rTiles remaining: " << tiles_left << " " << std::flush;
+				else
+					std::clog << "\rSamples " << sample_end << ", pixels still sampling: " << active_pixels << "    " << std::flush;
+				progress_mtx.unlock();
+			}
+		}
+
+		thread_stats().busy_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		worker_stats[worker].add(thread_stats());
+	}
+
+	void render_pixel(int i, int j, int sample_begin, int sample_end)
+	{
+		size_t index = size_t(j) * image_width + i;
+		if (!pixel_active.empty() && !pixel_active[index])
+			return;
+
+		Color pixel_color(0, 0, 0);
+		double luminance_sq = 0;
+		SampleFeatures feature_sum = {}, first_hit = {};
+		for (int sample = sample_begin; sample < sample_end; sample++)
+		{
+			start_sample(sampler, i, j, image_width, image_height, sample, samples_per_pixel);
+			Ray r = get_ray(i, j);
+			Color sample_color = ray_color(r, max_depth, world, Color(1, 1, 1), fb.has_features() ? &first_hit : nullptr);
+			pixel_color += sample_color;
+			luminance_sq += luminance(sample_color) * luminance(sample_color);
+			feature_sum.albedo += first_hit.albedo;
+			feature_sum.normal += first_hit.normal;
+		}
+
+		add_pixel_samples(i, j, pixel_color, luminance_sq, sample_end - sample_begin, feature_sum);
+	}
+
+	int packet_rows() const
+	{
+		return std::max(1, std::min(packet_size, RayPacket::MAX_SIZE) / RayPacket::GROUP);
+	}
+
+	void render_block_packet(int i0, int j0, int width, int height, int sample_begin, int sample_end)
+	{
+		// the pixels of a block of at most GROUP columns and packet_rows() rows, lane row * GROUP + column
+		RayPacket packet;
+		packet.clear();
+		packet.size = RayPacket::GROUP * packet_rows();
+
+		int lane_mask = 0;
+		for (int lane = 0; lane < packet.size; lane++)
+		{
+			const int i = i0 + lane % RayPacket::GROUP, j = j0 + lane / RayPacket::GROUP;
+			if (i < i0 + width && j < j0 + height && (pixel_active.empty() || pixel_active[size_t(j) * image_width + i]))
+				lane_mask |= 1 << lane;
+		}
+		if (lane_mask == 0)
+			return;
+
+		Color pixel_colors[RayPacket::MAX_SIZE];
+		double luminance_sq[RayPacket::MAX_SIZE] = {};
+		SampleFeatures feature_sums[RayPacket::MAX_SIZE] = {};
+		RayPacket reflected;
+		reflected.clear();
+		reflected.size = packet.size;
+
+		for (int sample = sample_begin; sample < sample_end; sample++)
 		{
-			if (lines_rendered[j] == -1)
+			// every lane keeps its own generator state so it draws exactly the numbers render_pixel would
+			PCG32 lane_rngs[RayPacket::MAX_SIZE];
+			SamplerState lane_samplers[RayPacket::MAX_SIZE];
+			for (int lane = 0; lane < packet.size; lane++)
 			{
-				lines_rendered[j] = id;
-				std::clog << "\rScanlines remaining: " << std::to_string(lines_left) << " " << std::flush;
-				lines_left--;
+				if (!(lane_mask & (1 << lane)))
+					continue;
+
+				const int i = i0 + lane % RayPacket::GROUP, j = j0 + lane / RayPacket::GROUP;
+				start_sample(sampler, i, j, image_width, image_height, sample, samples_per_pixel);
+				packet.set(lane, get_ray(i, j));
+				lane_rngs[lane] = thread_rng();
+				lane_samplers[lane] = thread_sampler();
+			}
 
-				lock.unlock();
-				found_empty_line = true;
+			HitRecord recs[RayPacket::MAX_SIZE];
+			Real t_max[RayPacket::MAX_SIZE];
+			std::fill(t_max, t_max + RayPacket::MAX_SIZE, Real(INF));
+			RT_STAT(rays += max_depth > 0 ? RayPacket::lane_count(lane_mask) : 0);
+			int hit_mask = max_depth > 0 ? world.hit_packet(packet, lane_mask, Epsilon<Real>::ray_t_min(), t_max, recs) : 0;
 
-				// render the line
-				for (int i = 0; i < image_width; i++)
+			Color sample_colors[RayPacket::MAX_SIZE];
+			Bounce bounces[RayPacket::MAX_SIZE];
+			int reflected_mask = 0;
+			for (int lane = 0; lane < packet.size; lane++)
+			{
+				if (!(lane_mask & (1 << lane)))
+					continue;
+
+				thread_rng() = lane_rngs[lane];
+				thread_sampler() = lane_samplers[lane];
+				SampleFeatures first_hit = {};
+				const bool hit = (hit_mask >> lane) & 1;
+				if (max_depth > 1 && hit && reflects_coherently(materials[recs[lane].material_id]))
 				{
-					Color pixel_color(0, 0, 0);
-					for (int sample = 0; sample < samples_per_pixel; sample++)
+					// the first bounce of shade, with the reflected ray left for the second packet
+					if (fb.has_features())
+						first_hit = first_hit_features(packet.rays[lane], hit, recs[lane], materials);
+					if (scatter_hit(packet.rays[lane], recs[lane], max_depth, world, Color(1, 1, 1), bounces[lane]))
 					{
-						Ray r = get_ray(i, j);
-						pixel_color += ray_color(r, max_depth, world);
+						reflected.set(lane, bounces[lane].scattered);
+						reflected_mask |= 1 << lane;
+						lane_rngs[lane] = thread_rng();
+						lane_samplers[lane] = thread_sampler();
 					}
+					sample_colors[lane] = bounces[lane].direct;
+				}
+				else
+				{
+					sample_colors[lane] = max_depth > 0
+						? shade(packet.rays[lane], hit, recs[lane], max_depth, world, Color(1, 1, 1),
+							fb.has_features() ? &first_hit : nullptr)
+						: Color(0, 0, 0);
+				}
+				feature_sums[lane].albedo += first_hit.albedo;
+				feature_sums[lane].normal += first_hit.normal;
+			}
 
-					lines_as_string[j] += write_color(std::cout, pixel_samples_scale * pixel_color);
+			if (reflected_mask)
+			{
+				HitRecord reflected_recs[RayPacket::MAX_SIZE];
+				std::fill(t_max, t_max + RayPacket::MAX_SIZE, Real(INF));
+				RT_STAT(rays += RayPacket::lane_count(reflected_mask));
+				int reflected_hits = world.hit_packet(reflected, reflected_mask, Epsilon<Real>::ray_t_min(), t_max, reflected_recs);
+
+				for (int lane = 0; lane < packet.size; lane++)
+				{
+					if (!(reflected_mask & (1 << lane)))
+						continue;
+
+					// the rest of the path exactly as ray_color would follow it from the reflection
+					thread_rng() = lane_rngs[lane];
+					thread_sampler() = lane_samplers[lane];
+					const Bounce& bounce = bounces[lane];
+					sample_colors[lane] = bounce.direct + bounce.attenuation
+						* shade(bounce.scattered, (reflected_hits >> lane) & 1, reflected_recs[lane], max_depth - 1, world,
+							Color(1, 1, 1) * bounce.attenuation, nullptr, bounce.pdf);
 				}
-				break;
+			}
+
+			for (int lane = 0; lane < packet.size; lane++)
+			{
+				if (!(lane_mask & (1 << lane)))
+					continue;
+
+				pixel_colors[lane] += sample_colors[lane];
+				luminance_sq[lane] += luminance(sample_colors[lane]) * luminance(sample_colors[lane]);
 			}
 		}
 
-		if (lock.owns_lock())
+		for (int lane = 0; lane < packet.size; lane++)
 		{
-			lock.unlock();
+			if (lane_mask & (1 << lane))
+			{
+				add_pixel_samples(i0 + lane % RayPacket::GROUP, j0 + lane / RayPacket::GROUP, pixel_colors[lane], luminance_sq[lane],
+					sample_end - sample_begin, feature_sums[lane]);
+			}
 		}
+	}
+
+	bool reflects_coherently(const Material& mat) const
+	{
+		return mat.type() == MaterialType::Metal && mat.fuzziness() <= packet_reflection_fuzz;
+	}
+
+	void render_tile_wavefront(const Tile& tile, int sample_begin, int sample_end, WavefrontIntegrator& wavefront)
+	{
+		const int tile_width = tile.x1 - tile.x0;
+		const int tile_pixels = tile_width * (tile.y1 - tile.y0);
+		std::vector<Color> sums(tile_pixels, Color(0, 0, 0));
+		std::vector<double> luminance_sq(tile_pixels, 0.0);
+		std::vector<SampleFeatures> feature_sums(tile_pixels, SampleFeatures());
+		std::vector<int> path_pixel;		// tile pixel of every path in the current batch
+
+		auto flush = [&]()
+		{
+			wavefront.run();
+			for (int p = 0; p < wavefront.size(); p++)
+			{
+				const Color& c = wavefront.result(p);
+				sums[path_pixel[p]] += c;
+				luminance_sq[path_pixel[p]] += luminance(c) * luminance(c);
+				if (wavefront.collect_features)
+				{
+					feature_sums[path_pixel[p]].albedo += wavefront.features(p).albedo;
+					feature_sums[path_pixel[p]].normal += wavefront.features(p).normal;
+				}
+			}
+			wavefront.clear();
+			path_pixel.clear();
+		};
+
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			for (int i = tile.x0; i < tile.x1; i++)
+			{
+				size_t index = size_t(j) * image_width + i;
+				if (!pixel_active.empty() && !pixel_active[index])
+					continue;
+
+				for (int sample = sample_begin; sample < sample_end; sample++)
+				{
+					if (wavefront.size() >= wavefront_batch_size)
+						flush();
+
+					start_sample(sampler, i, j, image_width, image_height, sample, samples_per_pixel);
+					Ray r = get_ray(i, j);
+					wavefront.add_path(r, thread_rng(), thread_sampler());
+					path_pixel.push_back((j - tile.y0) * tile_width + (i - tile.x0));
+				}
+			}
+		}
+		flush();
+
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			for (int i = tile.x0; i < tile.x1; i++)
+			{
+				if (!pixel_active.empty() && !pixel_active[size_t(j) * image_width + i])
+					continue;
+
+				int k = (j - tile.y0) * tile_width + (i - tile.x0);
+				add_pixel_samples(i, j, sums[k], luminance_sq[k], sample_end - sample_begin, feature_sums[k]);
+			}
+		}
+	}
+
+	void add_pixel_samples(int i, int j, const Color& sum, double luminance_sq, int num_samples, const SampleFeatures& feature_sum)
+	{
+		fb.add_samples(i, j, sum, luminance_sq, num_samples);
+		if (fb.has_features())
+			fb.add_features(i, j, feature_sum.albedo, feature_sum.normal, num_samples);
+
+		if (!pixel_active.empty() && pixel_converged(i, j))
+		{
+			pixel_active[size_t(j) * image_width + i] = 0;
+			active_pixels--;
+		}
+	}
+
+	bool pixel_converged(int i, int j) const
+	{
+		return fb.sample_count(i, j) >= min_samples && pixel_noise(i, j) < adaptive_threshold;
+	}
+
+	double pixel_noise(int i, int j) const
+	{
+		// half width of the 95% confidence interval of the mean luminance, mapped through the derivative of the
+		// gamma 2 transform onto the displayed scale
+		int n = fb.sample_count(i, j);
+		double mean = luminance(fb.pixel(i, j));
+		double half_width = 1.96 * sqrt(fb.luminance_variance(i, j) / n);
+		return half_width / (2.0 * sqrt(mean > 1e-4 ? mean : 1e-4));
+	}
+
+	double image_noise() const
+	{
+		// mean pixel_noise over the rendered rows, which needs at least two samples per pixel to estimate
+		double sum = 0;
+		for (int j = first_row; j < row_limit(); j++)
+		{
+			for (int i = 0; i < image_width; i++)
+			{
+				if (fb.sample_count(i, j) < 2)
+					return INF;
+				sum += pixel_noise(i, j);
+			}
+		}
+		return sum / (double(image_width) * (row_limit() - first_row));
+	}
+
+	bool write_features() const
+	{
+		// normals are mapped from [-1, 1] to [0, 1] and squared, so the gamma 2 writers store them linearly
+		Framebuffer albedo(image_width, image_height), normal(image_width, image_height);
+		for (int j = 0; j < image_height; j++)
+		{
+			for (int i = 0; i < image_width; i++)
+			{
+				Vec3 n = 0.5 * (fb.normal(i, j) + Vec3(1, 1, 1));
+				albedo.add_samples(i, j, fb.albedo(i, j), 0, 1);
+				normal.add_samples(i, j, n * n, 0, 1);
+			}
+		}
+
+		bool written = true;
+		if (!albedo_path.empty() && !make_image_writer(albedo_path)->write(albedo, albedo_path))
+		{
+			std::clog << "Failed to write " << albedo_path << "\n";
+			written = false;
+		}
+		if (!normal_path.empty() && !make_image_writer(normal_path)->write(normal, normal_path))
+		{
+			std::clog << "Failed to write " << normal_path << "\n";
+			written = false;
+		}
+		return written;
+	}
+
+	bool write_sample_heatmap() const
+	{
+		// blue for the fewest samples through green to red for samples_per_pixel
+		Framebuffer heatmap(image_width, image_height);
+		long long total_samples = 0;
+		for (int j = 0; j < image_height; j++)
+		{
+			for (int i = 0; i < image_width; i++)
+			{
+				int n = fb.sample_count(i, j);
+				total_samples += n;
+
+				double t = double(n) / samples_per_pixel;
+				Color c = t < 0.5 ? Color(0, 2 * t, 1 - 2 * t) : Color(2 * t - 1, 2 - 2 * t, 0);
+				heatmap.add_samples(i, j, c * c, 0, 1);		// squared so the gamma 2 writers show the ramp linearly
+			}
+		}
+
+		std::clog << "\rAverage samples per pixel: " << double(total_samples) / (double(image_width) * image_height) << "\n";
 
-		if (found_empty_line)
+		if (!make_image_writer(sample_heatmap_path)->write(heatmap, sample_heatmap_path))
 		{
-			render_next_line(id);
+			std::clog << "Failed to write " << sample_heatmap_path << "\n";
+			return false;
 		}
+		return true;
 	}
 };
 
@@ -0,0 +1,96 @@
+#pragma once
+
+#ifndef CHECKPOINT_WRITER_H
+#define CHECKPOINT_WRITER_H
+
+#include "PartialBuffer.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class CheckpointWriter
+{
+public:
+	// writes framebuffer snapshots to a partial buffer file on its own thread, so the render never waits for the disk
+	// only the newest snapshot is kept while a write is in progress, older ones are dropped rather than queued
+	// write_file may store the snapshot some other way, e.g. as the image previews of a progressive render
+	typedef std::function<bool(const Framebuffer&, const PartialRange&, const std::string&)> WriteFunction;
+
+	CheckpointWriter(const std::string& path, WriteFunction write_file = write_partial)
+		: path(path), write_file(write_file), thread(&CheckpointWriter::run, this) {}
+
+	~CheckpointWriter() { finish(); }
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	void submit(const Framebuffer& fb, const PartialRange& range)
+	{
+		// the copy is the only cost to the caller, it reuses the buffer the writer handed back by its last swap
+		std::lock_guard<std::mutex> lock(mtx);
+		pending = fb;
+		pending_range = range;
+		has_pending = true;
+		wake.notify_one();
+	}
+
+	bool finish()
+	{
+		// writes whatever is still pending, then stops the thread, returns whether every write succeeded
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+			wake.notify_one();
+		}
+		if (thread.joinable())
+			thread.join();
+		return !failed;
+	}
+
+private:
+	std::string path;
+	WriteFunction write_file;
+	std::mutex mtx;
+	std::condition_variable wake;
+	Framebuffer pending;
+	PartialRange pending_range = {};
+	bool has_pending = false;
+	bool stopping = false;
+	bool failed = false;		// only touched by the writer thread until it is joined
+	std::thread thread;		// started last, once everything it uses is initialised
+
+	void run()
+	{
+		Framebuffer snapshot;
+		PartialRange range;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				wake.wait(lock, [this]() { return has_pending || stopping; });
+				if (!has_pending)
+					return;
+
+				std::swap(snapshot, pending);
+				range = pending_range;
+				has_pending = false;
+			}
+
+			// a complete file replaces the previous checkpoint in one rename, so a render killed mid-write keeps the old one
+			// (Windows refuses to rename onto an existing file, there the old one has to go first)
+			const std::string temp_path = path + ".tmp";
+			if (write_file(snapshot, range, temp_path) && (std::rename(temp_path.c_str(), path.c_str()) == 0
+				|| (std::remove(path.c_str()) == 0 && std::rename(temp_path.c_str(), path.c_str()) == 0)))
+				continue;
+
+			std::clog << "\nFailed to write " << path << "\n";
+			failed = true;
+		}
+	}
+};
+
+#endif
@@ -3,8 +3,6 @@
 #ifndef COLOR_H
 #define COLOR_H
 
-#include <string>
-
 #include "Interval.h"
 
 using Color = Vec3;
@@ -17,7 +15,23 @@ inline double linear_to_gamma(double linear_component)
 	return 0;
 }
 
-std::string write_color(std::ostream& out, const Color& pixel_color)
+inline double luminance(const Color& c)
+{
+	// Rec. 709 luma weights
+	return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+inline double roulette_survival(const Color& throughput)
+{
+	// Russian roulette continues a path with a probability that follows its brightest throughput channel,
+	// paths still at full strength always continue and no path is kept with certainty below that
+	double m = std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z()));
+	if (m >= 1)
+		return 1;
+	return m < 0.95 ? m : 0.95;
+}
+
+inline void color_to_bytes(const Color& pixel_color, unsigned char* rgb)
 {
 	double r = pixel_color.x();
 	double g = pixel_color.y();
@@ -30,12 +44,16 @@ std::string write_color(std::ostream& out, const Color& pixel_color)
 
 	// translate from 0 to 1 into 0 to 255
 	static const Interval intensity(0.0, 0.999);
-	int rbyte = int(256 * intensity.clamp(r));
-	int gbyte = int(256 * intensity.clamp(g));
-	int bbyte = int(256 * intensity.clamp(b));
+	rgb[0] = (unsigned char)(256 * intensity.clamp(r));
+	rgb[1] = (unsigned char)(256 * intensity.clamp(g));
+	rgb[2] = (unsigned char)(256 * intensity.clamp(b));
+}
 
-	std::string out_color = std::to_string(rbyte) + " " + std::to_string(gbyte) + " " + std::to_string(bbyte) + "\n";
-	return out_color;
+inline void write_color(std::ostream& out, const Color& pixel_color)
+{
+	unsigned char rgb[3];
+	color_to_bytes(pixel_color, rgb);
+	out << int(rgb[0]) << ' ' << int(rgb[1]) << ' ' << int(rgb[2]) << '\n';
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+
+class Denoiser
+{
+public:
+	// edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the framebuffer's first-hit features:
+	// each iteration blurs with a 5x5 B3 spline kernel whose taps are step = 1, 2, 4, ... pixels apart, and weights
+	// every tap down by how far its colour, normal and albedo are from the centre pixel's, so edges stay sharp
+	// colours are divided by their albedo first and multiplied back after, which keeps texture out of the blur
+	// colour distances are measured in standard deviations of the pixel's estimated noise, which the filter tracks
+	// as it averages, so noisy pixels blur freely and converged ones keep their detail
+	int iterations = 5;
+	float color_sigma = 6.0f;		// in standard deviations of the pixel mean
+	float normal_sigma = 0.2f;
+	float albedo_sigma = 0.1f;
+	int num_threads = 0;			// 0 uses every hardware thread
+
+	Framebuffer run(const Framebuffer& noisy) const
+	{
+		// returns the filtered image with one sample per pixel, noisy must have been rendered with features
+		// the fourth colour plane is the variance of the pixel mean
+		Planes color(noisy.width(), noisy.height(), 4), guides(noisy.width(), noisy.height(), 6);
+		for (int j = 0; j < noisy.height(); j++)
+		{
+			for (int i = 0; i < noisy.width(); i++)
+			{
+				const size_t p = size_t(j) * noisy.width() + i;
+				Color c = noisy.pixel(i, j), a = noisy.albedo(i, j);
+				Vec3 n = noisy.normal(i, j);
+				int count = noisy.sample_count(i, j);
+				Real l = luminance(Color(demodulation(a[0]), demodulation(a[1]), demodulation(a[2])));
+				color.planes[3][p] = count > 1 ? float(noisy.luminance_variance(i, j) / count / (l * l)) : 0.0f;
+				for (int k = 0; k < 3; k++)
+				{
+					color.planes[k][p] = float(c[k] / demodulation(a[k]));
+					guides.planes[k][p] = float(a[k]);
+					guides.planes[3 + k][p] = float(n[k]);
+				}
+			}
+		}
+
+		Planes filtered(noisy.width(), noisy.height(), 4);
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			filter_parallel(color, guides, filtered, 1 << iteration);
+			std::swap(color, filtered);
+		}
+
+		Framebuffer result(noisy.width(), noisy.height());
+		for (int j = 0; j < noisy.height(); j++)
+		{
+			for (int i = 0; i < noisy.width(); i++)
+			{
+				if (noisy.sample_count(i, j) == 0)
+					continue;
+
+				const size_t p = size_t(j) * noisy.width() + i;
+				Color a = noisy.albedo(i, j);
+				Color c(color.planes[0][p] * demodulation(a[0]), color.planes[1][p] * demodulation(a[1]),
+					color.planes[2][p] * demodulation(a[2]));
+				result.add_samples(i, j, c, luminance(c) * luminance(c), 1);
+			}
+		}
+		return result;
+	}
+
+private:
+	static const int BLOCK = 64;		// pixels of a row filtered together
+
+	struct Planes
+	{
+		// one float plane per channel in row-major order, so the filter's inner loops run over contiguous floats
+		int width, height;
+		std::vector<std::vector<float>> planes;
+
+		Planes(int width, int height, int channels)
+			: width(width), height(height), planes(channels, std::vector<float>(size_t(width) * height)) {}
+	};
+
+	static Real demodulation(Real albedo) { return std::max(albedo, Real(0.01)); }
+
+	static float exp_neg(float x)
+	{
+		// e^-x for x >= 0 as (1 - x/256)^256, plenty for filter weights and, unlike std::exp, vectorised by compilers
+		// beyond x = 16 the weight, below 1e-7, is flushed to zero, before it or its square in the variance sum reach
+		// denormals and slow every tap down
+		float t = x < 16 ? 1.0f - x * (1.0f / 256) : 0.0f;
+		for (int k = 0; k < 8; k++)
+			t *= t;
+		return t;
+	}
+
+	void filter_parallel(const Planes& in, const Planes& guides, Planes& out, int step) const
+	{
+		// every worker filters its own band of rows, each iteration reads only the previous one's output
+		int num_workers = num_threads > 0 ? num_threads : int(std::thread::hardware_concurrency());
+		num_workers = std::max(1, std::min(num_workers, in.height));
+
+		std::vector<std::future<void>> futures;
+		for (int w = 0; w < num_workers; w++)
+		{
+			int first_row = in.height * w / num_workers;
+			int end_row = in.height * (w + 1) / num_workers;
+			futures.push_back(std::async(std::launch::async, &Denoiser::filter_rows, this, std::cref(in), std::cref(guides),
+				std::ref(out), step, first_row, end_row));
+		}
+		for (auto& future : futures)
+			future.get();
+	}
+
+	void filter_rows(const Planes& in, const Planes& guides, Planes& out, int step, int first_row, int end_row) const
+	{
+		static const float KERNEL[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+		const int width = in.width;
+		const float inv_normal_sq = 1.0f / (normal_sigma * normal_sigma);
+		const float inv_albedo_sq = 1.0f / (albedo_sigma * albedo_sigma);
+		const float color_sigma_sq = color_sigma * color_sigma;
+
+		for (int y = first_row; y < end_row; y++)
+		{
+			const size_t row = size_t(y) * width;
+			const float* cr = in.planes[0].data() + row;
+			const float* cg = in.planes[1].data() + row;
+			const float* cb = in.planes[2].data() + row;
+			const float* cv = in.planes[3].data() + row;
+			const float* ar = guides.planes[0].data() + row;
+			const float* ag = guides.planes[1].data() + row;
+			const float* ab = guides.planes[2].data() + row;
+			const float* nx = guides.planes[3].data() + row;
+			const float* ny = guides.planes[4].data() + row;
+			const float* nz = guides.planes[5].data() + row;
+
+			// a row is done in blocks whose sums live on the stack, where the compiler can see that the loads of the
+			// inner loop never alias them and vectorise it
+			for (int block = 0; block < width; block += BLOCK)
+			{
+				float sum_r[BLOCK] = {}, sum_g[BLOCK] = {}, sum_b[BLOCK] = {}, sum_v[BLOCK] = {}, weight_sum[BLOCK] = {};
+				float inv_color_sq[BLOCK];
+				const int block_end = std::min(block + BLOCK, width);
+
+				// the small floor keeps pixels that saw no noise at all, like the sky, from refusing every neighbour
+				for (int x = block; x < block_end; x++)
+					inv_color_sq[x - block] = 1.0f / (color_sigma_sq * cv[x] + 1e-6f);
+
+				// taps that fall outside the image are left out rather than clamped, the weights are normalised anyway
+				for (int ky = 0; ky < 5; ky++)
+				{
+					const int yy = y + (ky - 2) * step;
+					if (yy < 0 || yy >= in.height)
+						continue;
+
+					const size_t tap_row = size_t(yy) * width;
+					const float* qr = in.planes[0].data() + tap_row;
+					const float* qg = in.planes[1].data() + tap_row;
+					const float* qb = in.planes[2].data() + tap_row;
+					const float* qv = in.planes[3].data() + tap_row;
+					const float* qar = guides.planes[0].data() + tap_row;
+					const float* qag = guides.planes[1].data() + tap_row;
+					const float* qab = guides.planes[2].data() + tap_row;
+					const float* qnx = guides.planes[3].data() + tap_row;
+					const float* qny = guides.planes[4].data() + tap_row;
+					const float* qnz = guides.planes[5].data() + tap_row;
+
+					for (int kx = 0; kx < 5; kx++)
+					{
+						const int dx = (kx - 2) * step;
+						const float h = KERNEL[ky] * KERNEL[kx];
+						const int x0 = std::max(block, -dx), x1 = std::min(block_end, width - dx);
+
+						for (int x = x0; x < x1; x++)
+						{
+							float dr = qr[x + dx] - cr[x], dg = qg[x + dx] - cg[x], db = qb[x + dx] - cb[x];
+							float dar = qar[x + dx] - ar[x], dag = qag[x + dx] - ag[x], dab = qab[x + dx] - ab[x];
+							float dnx = qnx[x + dx] - nx[x], dny = qny[x + dx] - ny[x], dnz = qnz[x + dx] - nz[x];
+
+							float distance = (dr * dr + dg * dg + db * db) * inv_color_sq[x - block]
+								+ (dnx * dnx + dny * dny + dnz * dnz) * inv_normal_sq
+								+ (dar * dar + dag * dag + dab * dab) * inv_albedo_sq;
+							float w = h * exp_neg(distance);
+
+							sum_r[x - block] += w * qr[x + dx];
+							sum_g[x - block] += w * qg[x + dx];
+							sum_b[x - block] += w * qb[x + dx];
+							sum_v[x - block] += w * w * qv[x + dx];
+							weight_sum[x - block] += w;
+						}
+					}
+				}
+
+				// the centre tap always has weight, so the sum is never zero
+				for (int x = block; x < block_end; x++)
+				{
+					float inv_weight = 1.0f / weight_sum[x - block];
+					out.planes[0][row + x] = sum_r[x - block] * inv_weight;
+					out.planes[1][row + x] = sum_g[x - block] * inv_weight;
+					out.planes[2][row + x] = sum_b[x - block] * inv_weight;
+					out.planes[3][row + x] = sum_v[x - block] * inv_weight * inv_weight;
+				}
+			}
+		}
+	}
+};
+
+#endif
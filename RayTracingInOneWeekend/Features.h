@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef FEATURES_H
+#define FEATURES_H
+
+#include "Hittable.h"
+#include "MaterialTable.h"
+#include "Sky.h"
+
+struct SampleFeatures
+{
+	// what a camera ray first sees besides its light, noise free guides for the denoiser
+	Color albedo;
+	Vec3 normal;
+};
+
+inline SampleFeatures first_hit_features(const Ray& r, bool hit, const HitRecord& rec, const MaterialTable& materials)
+{
+	// misses see the sky, whose colour is its own albedo, and have no normal
+	if (!hit)
+		return { sky_color(r), Vec3(0, 0, 0) };
+	return { materials[rec.material_id].color(), rec.normal };
+}
+
+#endif
@@ -0,0 +1,448 @@
+#pragma once
+
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include "BVH.h"
+#include "SIMD.h"
+#include "SphereSet.h"
+
+#include <vector>
+
+struct alignas(32) BVH4Node
+{
+	// child bounds in SoA layout: min x, max x, min y, max y, min z, max z, one lane per child
+	Real bounds[6][4];
+
+	// >= 0 is the index of an interior node, < 0 is ~index into the leaf array
+	int child[4];
+
+	// split axes of the collapsed binary nodes: the top split, then the splits of each child pair
+	int axis[3];
+
+	// bit i is set when slot i holds a child, empty slots have inverted (empty) bounds
+	int slot_mask;
+};
+
+struct BVH4Leaf
+{
+	int sphere_first;		// spheres are packed into a SphereSet, padded to its SIMD width
+	int sphere_count;
+	int first;				// everything else is tested through its own virtual hit
+	int count;
+};
+
+class FlatBVH : public Hittable
+{
+public:
+	static const int STACK_SIZE = 256;
+
+	FlatBVH(const HittableList& list)
+	{
+		build({ nullptr, raw_pointers(list.objects) });
+		share(list.objects);
+	}
+
+	FlatBVH(const SphereSet& set)
+	{
+		// builds straight from packed sphere arrays, e.g. a loaded scene, without a Hittable per sphere
+		build({ &set, raw_pointers(set.unpacked().objects) });
+		share(set.unpacked().objects);
+	}
+
+	FlatBVH(const SphereSet& set, const std::vector<const Hittable*>& objects)
+	{
+		// objects are not owned, whoever made them, e.g. a SceneBuilder's arena, has to keep them alive
+		build({ &set, objects });
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override
+	{
+		struct StackEntry
+		{
+			int child;
+			Real t_near;
+		};
+
+		StackEntry stack[STACK_SIZE];
+		int stack_size = 0;
+		stack[stack_size++] = { 0, ray_t.min };
+
+		const Real4 orig_x = Real4::broadcast(r.origin()[0]);
+		const Real4 orig_y = Real4::broadcast(r.origin()[1]);
+		const Real4 orig_z = Real4::broadcast(r.origin()[2]);
+		const Real4 inv_x = Real4::broadcast(r.inverse_direction()[0]);
+		const Real4 inv_y = Real4::broadcast(r.inverse_direction()[1]);
+		const Real4 inv_z = Real4::broadcast(r.inverse_direction()[2]);
+
+		// offsets of the entry and exit planes in BVH4Node::bounds, fixed for the whole traversal by the direction signs
+		const int near_x = r.sign(0), far_x = 1 - near_x;
+		const int near_y = 2 + r.sign(1), far_y = 5 - near_y;
+		const int near_z = 4 + r.sign(2), far_z = 9 - near_z;
+
+		bool hit_anything = false;
+		Real closest_so_far = ray_t.max;
+
+		while (stack_size > 0)
+		{
+			const StackEntry entry = stack[--stack_size];
+			if (entry.t_near > closest_so_far)
+				continue;
+
+			if (entry.child < 0)
+			{
+				const BVH4Leaf& leaf = leaves[~entry.child];
+				if (leaf.sphere_count > 0
+					&& spheres.hit_range(r, Interval(ray_t.min, closest_so_far), rec, leaf.sphere_first, leaf.sphere_count))
+				{
+					hit_anything = true;
+					closest_so_far = rec.t;
+				}
+
+				for (int i = leaf.first; i < leaf.first + leaf.count; i++)
+				{
+					if (prims[i]->hit(r, Interval(ray_t.min, closest_so_far), rec))
+					{
+						hit_anything = true;
+						closest_so_far = rec.t;
+					}
+				}
+				continue;
+			}
+
+			const BVH4Node& node = nodes[entry.child];
+			RT_STAT(bvh_nodes++);
+			RT_STAT(box_tests += RayPacket::lane_count(node.slot_mask));		// empty slots are masked out, not tested
+
+			// slab test against all four children at once
+			Real4 t_near = max(
+				max((Real4::load(node.bounds[near_x]) - orig_x) * inv_x, (Real4::load(node.bounds[near_y]) - orig_y) * inv_y),
+				max((Real4::load(node.bounds[near_z]) - orig_z) * inv_z, Real4::broadcast(ray_t.min)));
+			Real4 t_far = min(
+				min((Real4::load(node.bounds[far_x]) - orig_x) * inv_x, (Real4::load(node.bounds[far_y]) - orig_y) * inv_y),
+				min((Real4::load(node.bounds[far_z]) - orig_z) * inv_z, Real4::broadcast(closest_so_far)));
+
+			int hit_mask = less_than(t_near, t_far) & node.slot_mask;
+			if (hit_mask == 0)
+				continue;
+
+			Real t_near_lanes[4];
+			t_near.store(t_near_lanes);
+
+			// visit children front to back along the split axes, so push them back to front
+			int order[4];
+			visit_order(r, node, order);
+
+			for (int k = 3; k >= 0; k--)
+			{
+				int c = order[k];
+				if (hit_mask & (1 << c))
+					stack[stack_size++] = { node.child[c], t_near_lanes[c] };
+			}
+		}
+
+		return hit_anything;
+	}
+
+	int hit_packet(const RayPacket& packet, int lane_mask, Real t_min, Real* t_max, HitRecord* recs) const override
+	{
+		// each stack entry carries the lanes whose rays entered that child, so leaves only test rays that can hit them
+		struct StackEntry
+		{
+			int child;
+			int lane_mask;
+		};
+
+		StackEntry stack[STACK_SIZE];
+		int stack_size = 0;
+		stack[stack_size++] = { 0, lane_mask };
+
+		// coherent packets share direction signs, so the first active lane decides the visiting order
+		int first_lane = 0;
+		while (first_lane < packet.size - 1 && !(lane_mask & (1 << first_lane)))
+			first_lane++;
+		const Ray& lead = packet.rays[first_lane];
+
+		int hit_mask = 0;
+		while (stack_size > 0)
+		{
+			const StackEntry entry = stack[--stack_size];
+
+			if (entry.child < 0)
+			{
+				const BVH4Leaf& leaf = leaves[~entry.child];
+				if (leaf.sphere_count > 0)
+				{
+					hit_mask |= spheres.hit_packet_range(packet, entry.lane_mask, t_min, t_max, recs,
+						leaf.sphere_first, leaf.sphere_count);
+				}
+
+				for (int i = leaf.first; i < leaf.first + leaf.count; i++)
+					hit_mask |= prims[i]->hit_packet(packet, entry.lane_mask, t_min, t_max, recs);
+				continue;
+			}
+
+			const BVH4Node& node = nodes[entry.child];
+			RT_STAT(bvh_nodes++);
+
+			int child_masks[4] = { 0, 0, 0, 0 };
+			for (int c = 0; c < 4; c++)
+			{
+				if (!(node.slot_mask & (1 << c)))
+					continue;
+
+				const Real lo[3] = { node.bounds[0][c], node.bounds[2][c], node.bounds[4][c] };
+				const Real hi[3] = { node.bounds[1][c], node.bounds[3][c], node.bounds[5][c] };
+				child_masks[c] = packet.box_hit_mask(lo, hi, t_min, t_max, entry.lane_mask);
+			}
+
+			int order[4];
+			visit_order(lead, node, order);
+
+			for (int k = 3; k >= 0; k--)
+			{
+				int c = order[k];
+				if (child_masks[c])
+					stack[stack_size++] = { node.child[c], child_masks[c] };
+			}
+		}
+
+		return hit_mask;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+	void refit(const SphereSet& source)
+	{
+		// moves the spheres that were built from source to its current centres and radii, then recomputes every bound
+		// bottom up in place, the tree keeps its topology, so its quality drops as spheres drift far from where it was built
+		// source must be the set this was built from, with the same spheres in the same order
+		for (int p = 0; p < spheres.size(); p++)
+		{
+			int s = sphere_sources[p];
+			if (s >= 0)
+				spheres.set_sphere(p, source.center(s), source.radius(s));
+		}
+		if (!nodes.empty())
+			bbox = refit_child(0);
+	}
+
+private:
+	std::vector<BVH4Node, AlignedAllocator<BVH4Node>> nodes;
+	std::vector<BVH4Leaf> leaves;
+	SphereSet spheres;									// in leaf order
+	std::vector<int> sphere_sources;					// per packed sphere its index in the SphereSet built from, or -1
+	std::vector<const Hittable*> prims;		// in leaf order
+	std::vector<std::shared_ptr<Hittable>> owned;		// keeps what prims point to alive, unless the caller does
+	AABB bbox;
+
+	struct BuildInput
+	{
+		const SphereSet* spheres;		// primitive indices below spheres->size() are spheres of this set
+		const std::vector<const Hittable*>& objects;		// the rest, offset by the size of the set
+	};
+
+	void build(const BuildInput& input)
+	{
+		int sphere_count = input.spheres ? input.spheres->size() : 0;
+		std::vector<BVHPrimitive> build_prims;
+		build_prims.reserve(sphere_count + input.objects.size());
+		for (int i = 0; i < sphere_count; i++)
+		{
+			if (input.spheres->is_padding(i))
+				continue;
+
+			AABB box = input.spheres->sphere_bounding_box(i);
+			build_prims.push_back({ box, box.centroid(), i });
+		}
+		for (int i = 0; i < int(input.objects.size()); i++)
+		{
+			AABB box = input.objects[i]->bounding_box();
+			build_prims.push_back({ box, box.centroid(), sphere_count + i });
+		}
+
+		// a leaf's spheres are tested SphereSet::WIDTH at a time, so full leaves cost about as much as single ones
+		BVHBuilder builder;
+		builder.max_leaf_size = SphereSet::WIDTH;
+		builder.traversal_cost = SphereSet::WIDTH;
+		int root = builder.build(build_prims);
+
+		bbox = builder.nodes[root].bbox;
+		nodes.reserve(builder.nodes.size() / 2 + 1);
+		collapse(builder.nodes, root, build_prims, input);
+	}
+
+	static std::vector<const Hittable*> raw_pointers(const std::vector<std::shared_ptr<Hittable>>& objects)
+	{
+		std::vector<const Hittable*> pointers;
+		pointers.reserve(objects.size());
+		for (const std::shared_ptr<Hittable>& object : objects)
+			pointers.push_back(object.get());
+		return pointers;
+	}
+
+	void share(const std::vector<std::shared_ptr<Hittable>>& objects)
+	{
+		// spheres were copied into the leaves, everything else is pointed to by prims
+		for (const std::shared_ptr<Hittable>& object : objects)
+		{
+			if (!dynamic_cast<const Sphere*>(object.get()))
+				owned.push_back(object);
+		}
+	}
+
+	static void visit_order(const Ray& r, const BVH4Node& node, int* order)
+	{
+		const int left_first = r.sign(node.axis[1]);
+		const int right_first = 2 + r.sign(node.axis[2]);
+		if (r.sign(node.axis[0]))
+		{
+			order[0] = right_first; order[1] = 5 - right_first;
+			order[2] = left_first; order[3] = 1 - left_first;
+		}
+		else
+		{
+			order[0] = left_first; order[1] = 1 - left_first;
+			order[2] = right_first; order[3] = 5 - right_first;
+		}
+	}
+
+	int make_leaf(const BVHBuildNode& build_node, const std::vector<BVHPrimitive>& build_prims, const BuildInput& input)
+	{
+		int sphere_count = input.spheres ? input.spheres->size() : 0;
+		BVH4Leaf leaf = { spheres.size(), 0, int(prims.size()), 0 };
+		for (int i = build_node.first; i < build_node.first + build_node.count; i++)
+		{
+			int index = build_prims[i].index;
+			if (index < sphere_count)
+			{
+				spheres.add(input.spheres->center(index), input.spheres->radius(index), input.spheres->material_id(index));
+				sphere_sources.push_back(index);
+				continue;
+			}
+
+			const Hittable* object = input.objects[index - sphere_count];
+			if (const Sphere* sphere = dynamic_cast<const Sphere*>(object))
+			{
+				spheres.add(*sphere);
+				sphere_sources.push_back(-1);
+			}
+			else
+			{
+				prims.push_back(object);
+			}
+		}
+
+		spheres.pad();
+		sphere_sources.resize(spheres.size(), -1);
+		leaf.sphere_count = spheres.size() - leaf.sphere_first;
+		leaf.count = int(prims.size()) - leaf.first;
+
+		leaves.push_back(leaf);
+		return ~(int(leaves.size()) - 1);
+	}
+
+	static void set_child_bounds(BVH4Node& node, int slot, const AABB& box)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.bounds[2 * axis][slot] = box.axis_interval(axis).min;
+			node.bounds[2 * axis + 1][slot] = box.axis_interval(axis).max;
+		}
+	}
+
+	AABB refit_child(int child)
+	{
+		// child is a node index, or ~leaf index as in BVH4Node::child, returns its new bounds
+		AABB box;
+		if (child < 0)
+		{
+			const BVH4Leaf& leaf = leaves[~child];
+			for (int s = leaf.sphere_first; s < leaf.sphere_first + leaf.sphere_count; s++)
+			{
+				if (!spheres.is_padding(s))
+					box = AABB(box, spheres.sphere_bounding_box(s));
+			}
+			for (int i = leaf.first; i < leaf.first + leaf.count; i++)
+				box = AABB(box, prims[i]->bounding_box());
+			return box;
+		}
+
+		BVH4Node& node = nodes[child];
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (!(node.slot_mask & (1 << slot)))
+				continue;
+
+			AABB child_box = refit_child(node.child[slot]);
+			set_child_bounds(node, slot, child_box);
+			box = AABB(box, child_box);
+		}
+		return box;
+	}
+
+	int collapse(const std::vector<BVHBuildNode>& build_nodes, int index, const std::vector<BVHPrimitive>& build_prims,
+		const BuildInput& input)
+	{
+		// pulls the grandchildren of a binary node up into one 4-wide node, leaving empty slots where a child is a leaf
+		int node_index = int(nodes.size());
+		nodes.push_back(BVH4Node());
+
+		const BVHBuildNode& build_node = build_nodes[index];
+		int slots[4] = { -1, -1, -1, -1 };
+		int axes[3] = { build_node.axis, 0, 0 };
+
+		if (build_node.is_leaf())
+		{
+			slots[0] = index;
+		}
+		else
+		{
+			const int pair[2] = { build_node.left, build_node.right };
+			for (int p = 0; p < 2; p++)
+			{
+				const BVHBuildNode& child = build_nodes[pair[p]];
+				if (child.is_leaf())
+				{
+					slots[2 * p] = pair[p];
+				}
+				else
+				{
+					slots[2 * p] = child.left;
+					slots[2 * p + 1] = child.right;
+					axes[1 + p] = child.axis;
+				}
+			}
+		}
+
+		int children[4] = { 0, 0, 0, 0 };
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (slots[slot] < 0)
+				continue;
+
+			const BVHBuildNode& child = build_nodes[slots[slot]];
+			children[slot] = child.is_leaf()
+				? make_leaf(child, build_prims, input)
+				: collapse(build_nodes, slots[slot], build_prims, input);
+		}
+
+		// nodes may have been reallocated by the recursion above
+		BVH4Node& node = nodes[node_index];
+		node.slot_mask = 0;
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (slots[slot] >= 0)
+				node.slot_mask |= 1 << slot;
+
+			set_child_bounds(node, slot, slots[slot] < 0 ? AABB() : build_nodes[slots[slot]].bbox);
+			node.child[slot] = children[slot];
+		}
+		for (int a = 0; a < 3; a++)
+			node.axis[a] = axes[a];
+
+		return node_index;
+	}
+};
+
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "RTWeekend.h"
+
+#include <vector>
+
+class Framebuffer
+{
+public:
+	Framebuffer() {}
+	Framebuffer(int width, int height) { resize(width, height); }
+
+	void resize(int new_width, int new_height, bool with_features = false)
+	{
+		image_width = new_width;
+		image_height = new_height;
+		sums.assign(3 * size_t(image_width) * image_height, 0.0f);
+		luminance_sq_sums.assign(size_t(image_width) * image_height, 0.0f);
+		counts.assign(size_t(image_width) * image_height, 0);
+
+		const size_t feature_pixels = with_features ? size_t(image_width) * image_height : 0;
+		albedo_sums.assign(3 * feature_pixels, 0.0f);
+		normal_sums.assign(3 * feature_pixels, 0.0f);
+		feature_counts.assign(feature_pixels, 0);
+	}
+
+	int width() const { return image_width; }
+	int height() const { return image_height; }
+
+	void add_samples(int i, int j, const Color& sum, double luminance_sq_sum, int num_samples)
+	{
+		// each pixel is only ever written by the worker that owns its tile, so no synchronisation is needed
+		size_t index = size_t(j) * image_width + i;
+		sums[3 * index + 0] += float(sum.x());
+		sums[3 * index + 1] += float(sum.y());
+		sums[3 * index + 2] += float(sum.z());
+		luminance_sq_sums[index] += float(luminance_sq_sum);
+		counts[index] += num_samples;
+	}
+
+	Color pixel(int i, int j) const
+	{
+		// the average of all samples accumulated so far, still in linear space
+		size_t index = size_t(j) * image_width + i;
+		if (counts[index] == 0)
+			return Color(0, 0, 0);
+
+		double scale = 1.0 / counts[index];
+		return scale * Color(sums[3 * index + 0], sums[3 * index + 1], sums[3 * index + 2]);
+	}
+
+	int sample_count(int i, int j) const { return counts[size_t(j) * image_width + i]; }
+
+	// first-hit albedo and normal averaged over the samples that recorded them, only kept when resized with features
+	bool has_features() const { return !feature_counts.empty(); }
+
+	void add_features(int i, int j, const Color& albedo_sum, const Vec3& normal_sum, int num_samples)
+	{
+		size_t index = size_t(j) * image_width + i;
+		for (int c = 0; c < 3; c++)
+		{
+			albedo_sums[3 * index + c] += float(albedo_sum[c]);
+			normal_sums[3 * index + c] += float(normal_sum[c]);
+		}
+		feature_counts[index] += num_samples;
+	}
+
+	Color albedo(int i, int j) const
+	{
+		size_t index = size_t(j) * image_width + i;
+		if (feature_counts[index] == 0)
+			return Color(0, 0, 0);
+
+		double scale = 1.0 / feature_counts[index];
+		return scale * Color(albedo_sums[3 * index + 0], albedo_sums[3 * index + 1], albedo_sums[3 * index + 2]);
+	}
+
+	Vec3 normal(int i, int j) const
+	{
+		// the mean of unit normals, shorter than one where a pixel spans an edge
+		size_t index = size_t(j) * image_width + i;
+		if (feature_counts[index] == 0)
+			return Vec3(0, 0, 0);
+
+		double scale = 1.0 / feature_counts[index];
+		return scale * Vec3(normal_sums[3 * index + 0], normal_sums[3 * index + 1], normal_sums[3 * index + 2]);
+	}
+
+	// the raw accumulated sums, which partial renders save and merge
+	Color sample_sum(int i, int j) const
+	{
+		size_t index = size_t(j) * image_width + i;
+		return Color(sums[3 * index + 0], sums[3 * index + 1], sums[3 * index + 2]);
+	}
+
+	double luminance_sq_sum(int i, int j) const { return luminance_sq_sums[size_t(j) * image_width + i]; }
+
+	double luminance_variance(int i, int j) const
+	{
+		// unbiased variance of a single sample's luminance
+		size_t index = size_t(j) * image_width + i;
+		int n = counts[index];
+		if (n < 2)
+			return INF;
+
+		double mean = luminance(pixel(i, j));
+		double variance = (luminance_sq_sums[index] - n * mean * mean) / (n - 1);
+		return variance > 0 ? variance : 0;
+	}
+
+private:
+	int image_width = 0;
+	int image_height = 0;
+	std::vector<float> sums;		// linear RGB sums, three floats per pixel in row-major order
+	std::vector<float> luminance_sq_sums;		// sums of squared sample luminance, for variance estimates
+	std::vector<int> counts;		// samples accumulated per pixel
+	std::vector<float> albedo_sums;		// feature sums, empty without features
+	std::vector<float> normal_sums;
+	std::vector<int> feature_counts;		// samples that recorded features, resumed renders lack them for earlier samples
+};
+
+#endif
@@ -4,15 +4,14 @@
 #define HITTABLE_H
 
 #include "AABB.h"
-
-class Material;
+#include "RayPacket.h"
 
 struct HitRecord
 {
 	Point3 p;
 	Vec3 normal;
-	std::shared_ptr<Material> mat;
-	double t;
+	int material_id;		// index into the scene's MaterialTable
+	Real t;
 	bool front_face;
 
 	void set_face_normal(const Ray& r, const Vec3& outward_normal)
@@ -31,6 +30,22 @@ public:
 
 	virtual bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const = 0;
 	virtual AABB bounding_box() const = 0;
+
+	virtual int hit_packet(const RayPacket& packet, int lane_mask, Real t_min, Real* t_max, HitRecord* recs) const
+	{
+		// intersects every lane in lane_mask, shrinking t_max and filling recs for lanes with a closer hit
+		// returns the mask of lanes that were hit, this fallback simply traces the lanes one by one
+		int hit_mask = 0;
+		for (int lane = 0; lane < packet.size; lane++)
+		{
+			if ((lane_mask & (1 << lane)) && hit(packet.rays[lane], Interval(t_min, t_max[lane]), recs[lane]))
+			{
+				t_max[lane] = recs[lane].t;
+				hit_mask |= 1 << lane;
+			}
+		}
+		return hit_mask;
+	}
 };
 
 #endif
\ No newline at end of file
@@ -26,7 +26,7 @@ public:
 	{
 		HitRecord temp_rec;
 		bool hit_anything = false;
-		double closest_so_far = ray_t.max;
+		Real closest_so_far = ray_t.max;
 
 		for (const std::shared_ptr<Hittable>& object : objects)
 		{
@@ -41,6 +41,15 @@ public:
 		return hit_anything;
 	}
 
+	int hit_packet(const RayPacket& packet, int lane_mask, Real t_min, Real* t_max, HitRecord* recs) const override
+	{
+		int hit_mask = 0;
+		for (const std::shared_ptr<Hittable>& object : objects)
+			hit_mask |= object->hit_packet(packet, lane_mask, t_min, t_max, recs);
+
+		return hit_mask;
+	}
+
 	AABB bounding_box() const override { return bbox; }
 
 private:
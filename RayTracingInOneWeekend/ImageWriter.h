@@ -0,0 +1,274 @@
+#pragma once
+
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "Framebuffer.h"
+
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ImageWriter
+{
+public:
+	virtual ~ImageWriter() = default;
+
+	virtual void write(const Framebuffer& fb, std::ostream& out) const = 0;
+
+	bool write(const Framebuffer& fb, const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		write(fb, file);
+		return bool(file);
+	}
+
+protected:
+	static std::vector<unsigned char> to_bytes(const Framebuffer& fb, int row_padding)
+	{
+		// gamma corrected 8 bit rows, each preceded by row_padding zero bytes
+		const size_t row_size = row_padding + 3 * size_t(fb.width());
+		std::vector<unsigned char> bytes(row_size * fb.height(), 0);
+		for (int j = 0; j < fb.height(); j++)
+		{
+			unsigned char* row = &bytes[j * row_size + row_padding];
+			for (int i = 0; i < fb.width(); i++)
+				color_to_bytes(fb.pixel(i, j), row + 3 * i);
+		}
+		return bytes;
+	}
+};
+
+class PPMTextWriter : public ImageWriter
+{
+public:
+	using ImageWriter::write;
+
+	void write(const Framebuffer& fb, std::ostream& out) const override
+	{
+		// plain text P3, only kept as a fallback for streaming to stdout
+		out << "P3\n" << fb.width() << " " << fb.height() << "\n255\n";
+		for (int j = 0; j < fb.height(); j++)
+		{
+			for (int i = 0; i < fb.width(); i++)
+				write_color(out, fb.pixel(i, j));
+		}
+	}
+};
+
+class PPMWriter : public ImageWriter
+{
+public:
+	using ImageWriter::write;
+
+	void write(const Framebuffer& fb, std::ostream& out) const override
+	{
+		std::vector<unsigned char> bytes = to_bytes(fb, 0);
+		out << "P6\n" << fb.width() << " " << fb.height() << "\n255\n";
+		out.write((const char*)bytes.data(), bytes.size());
+	}
+};
+
+class PNGWriter : public ImageWriter
+{
+public:
+	using ImageWriter::write;
+
+	void write(const Framebuffer& fb, std::ostream& out) const override
+	{
+		// every row starts with filter type 0, and the rows are wrapped in stored (uncompressed) deflate blocks
+		std::vector<unsigned char> raw = to_bytes(fb, 1);
+
+		std::vector<unsigned char> ihdr;
+		put_u32(ihdr, fb.width());
+		put_u32(ihdr, fb.height());
+		ihdr.push_back(8);		// bit depth
+		ihdr.push_back(2);		// colour type, truecolour
+		ihdr.push_back(0);		// compression method
+		ihdr.push_back(0);		// filter method
+		ihdr.push_back(0);		// interlace method
+
+		const size_t MAX_BLOCK = 65535;
+		std::vector<unsigned char> idat;
+		idat.reserve(raw.size() + raw.size() / MAX_BLOCK * 5 + 16);
+		idat.push_back(0x78);
+		idat.push_back(0x01);
+		size_t offset = 0;
+		do
+		{
+			size_t len = raw.size() - offset < MAX_BLOCK ? raw.size() - offset : MAX_BLOCK;
+			bool final_block = offset + len == raw.size();
+			idat.push_back(final_block ? 1 : 0);
+			idat.push_back((unsigned char)(len & 0xff));
+			idat.push_back((unsigned char)(len >> 8));
+			idat.push_back((unsigned char)(~len & 0xff));
+			idat.push_back((unsigned char)((~len >> 8) & 0xff));
+			idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + len);
+			offset += len;
+		} while (offset < raw.size());
+		put_u32(idat, adler32(raw));
+
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		out.write((const char*)signature, sizeof(signature));
+		write_chunk(out, "IHDR", ihdr);
+		write_chunk(out, "IDAT", idat);
+		write_chunk(out, "IEND", std::vector<unsigned char>());
+	}
+
+private:
+	static void put_u32(std::vector<unsigned char>& bytes, uint32_t v)
+	{
+		bytes.push_back((unsigned char)(v >> 24));
+		bytes.push_back((unsigned char)(v >> 16));
+		bytes.push_back((unsigned char)(v >> 8));
+		bytes.push_back((unsigned char)v);
+	}
+
+	static uint32_t adler32(const std::vector<unsigned char>& bytes)
+	{
+		uint32_t a = 1, b = 0;
+		size_t i = 0;
+		while (i < bytes.size())
+		{
+			// 5552 is the largest run that can't overflow b before the modulo
+			size_t end = i + 5552 < bytes.size() ? i + 5552 : bytes.size();
+			for (; i < end; i++)
+			{
+				a += bytes[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size)
+	{
+		static const std::vector<uint32_t> table = []()
+		{
+			std::vector<uint32_t> t(256);
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	static void write_chunk(std::ostream& out, const char* type, const std::vector<unsigned char>& data)
+	{
+		std::vector<unsigned char> header;
+		put_u32(header, uint32_t(data.size()));
+		header.insert(header.end(), type, type + 4);
+
+		uint32_t crc = crc32(0, header.data() + 4, 4);
+		crc = crc32(crc, data.data(), data.size());
+		std::vector<unsigned char> footer;
+		put_u32(footer, crc);
+
+		out.write((const char*)header.data(), header.size());
+		out.write((const char*)data.data(), data.size());
+		out.write((const char*)footer.data(), footer.size());
+	}
+};
+
+class PFMWriter : public ImageWriter
+{
+public:
+	using ImageWriter::write;
+
+	void write(const Framebuffer& fb, std::ostream& out) const override
+	{
+		// linear float RGB without gamma or clamping, stored bottom row first, the negative scale marks little endian
+		std::vector<float> data(3 * size_t(fb.width()) * fb.height());
+		for (int j = 0; j < fb.height(); j++)
+		{
+			float* row = &data[3 * size_t(fb.height() - 1 - j) * fb.width()];
+			for (int i = 0; i < fb.width(); i++)
+			{
+				Color c = fb.pixel(i, j);
+				row[3 * i + 0] = float(c.x());
+				row[3 * i + 1] = float(c.y());
+				row[3 * i + 2] = float(c.z());
+			}
+		}
+
+		out << "PF\n" << fb.width() << " " << fb.height() << "\n" << (host_is_little_endian() ? "-1.0" : "1.0") << "\n";
+		out.write((const char*)data.data(), data.size() * sizeof(float));
+	}
+};
+
+class HDRWriter : public ImageWriter
+{
+public:
+	using ImageWriter::write;
+
+	void write(const Framebuffer& fb, std::ostream& out) const override
+	{
+		// Radiance RGBE, linear like PFM: an 8 bit mantissa per channel sharing one exponent byte, scanlines written
+		// flat rather than run-length encoded, which every reader accepts
+		std::vector<unsigned char> data(4 * size_t(fb.width()) * fb.height());
+		for (int j = 0; j < fb.height(); j++)
+		{
+			unsigned char* row = &data[4 * size_t(j) * fb.width()];
+			for (int i = 0; i < fb.width(); i++)
+				to_rgbe(fb.pixel(i, j), row + 4 * i);
+		}
+
+		out << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << fb.height() << " +X " << fb.width() << "\n";
+		out.write((const char*)data.data(), data.size());
+	}
+
+private:
+	static void to_rgbe(const Color& c, unsigned char* rgbe)
+	{
+		double r = std::fmax(double(c.x()), 0.0), g = std::fmax(double(c.y()), 0.0), b = std::fmax(double(c.z()), 0.0);
+		double largest = std::fmax(r, std::fmax(g, b));
+		if (largest < 1e-32)
+		{
+			rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+			return;
+		}
+
+		// largest = mantissa * 2^exponent with mantissa in [0.5, 1), so the largest channel keeps 8 significant bits
+		int exponent;
+		double scale = std::frexp(largest, &exponent) * 256.0 / largest;
+		rgbe[0] = (unsigned char)(r * scale);
+		rgbe[1] = (unsigned char)(g * scale);
+		rgbe[2] = (unsigned char)(b * scale);
+		rgbe[3] = (unsigned char)(exponent + 128);
+	}
+};
+
+inline std::unique_ptr<ImageWriter> make_image_writer(const std::string& path)
+{
+	// picks the output format from the file extension, falling back to binary PPM
+	std::string ext = path.substr(path.find_last_of('.') == std::string::npos ? path.size() : path.find_last_of('.'));
+	for (char& c : ext)
+		c = char(std::tolower((unsigned char)c));
+
+	if (ext == ".png")
+		return std::make_unique<PNGWriter>();
+	if (ext == ".pfm")
+		return std::make_unique<PFMWriter>();
+	if (ext == ".hdr")
+		return std::make_unique<HDRWriter>();
+	return std::make_unique<PPMWriter>();
+}
+
+#endif
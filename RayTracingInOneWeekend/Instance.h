@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "Hittable.h"
+#include "Transform.h"
+
+class Instance : public Hittable
+{
+public:
+	// places a shared object, typically a FlatBVH over a whole cluster, in the world through an affine transform
+	// rays are taken into object space instead of copying the geometry, so an instance only costs its transforms
+	Instance(std::shared_ptr<Hittable> shared, const Transform& object_to_world)
+		: Instance(*shared, object_to_world)
+	{
+		owner = std::move(shared);
+	}
+
+	Instance(const Hittable& object, const Transform& object_to_world)
+		: object(&object), to_object(object_to_world.inverse())
+	{
+		// the object is not owned, e.g. when it lives in the same SceneBuilder arena as the instance
+		bbox = object_to_world.box(object.bounding_box());
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override
+	{
+		// the object space direction is left unnormalised, so t means the same in both spaces
+		RT_STAT(instance_tests++);
+
+		Ray local(to_object.point(r.origin()), to_object.vector(r.direction()));
+		if (!object->hit(local, ray_t, rec))
+			return false;
+
+		// front_face carries over, the sign of dot(direction, normal) is the same in both spaces
+		rec.p = r.at(rec.t);
+		rec.normal = unit_vector(to_object.transposed_vector(rec.normal));
+		return true;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+private:
+	std::shared_ptr<Hittable> owner;		// only for instances of a shared object
+	const Hittable* object;
+	Transform to_object;
+	AABB bbox;
+};
+
+#endif
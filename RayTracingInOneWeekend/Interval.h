@@ -5,23 +5,24 @@
 
 #include "RTWeekend.h"
 
-struct Interval
+template<typename T>
+struct IntervalT
 {
-	double min, max;
+	T min, max;
 
-	Interval() : min(+INF), max(-INF) {}
-	Interval(double min, double max) : min(min), max(max) {}
-	Interval(const Interval& a, const Interval& b)
+	IntervalT() : min(T(+INF)), max(T(-INF)) {}
+	IntervalT(T min, T max) : min(min), max(max) {}
+	IntervalT(const IntervalT& a, const IntervalT& b)
 	{
 		min = a.min <= b.min ? a.min : b.min;
-		max = a.max <= b.max ? a.max : b.max;
+		max = a.max >= b.max ? a.max : b.max;
 	}
 
-	double size() const { return max - min; }
-	bool contains(double x) const { return min <= x && x <= max; }
-	bool surrrounds(double x) const { return min < x && x < max; }
+	T size() const { return max - min; }
+	bool contains(T x) const { return min <= x && x <= max; }
+	bool surrrounds(T x) const { return min < x && x < max; }
 
-	double clamp(double x) const
+	T clamp(T x) const
 	{
 		if (x < min)
 			return min;
@@ -30,16 +31,20 @@ struct Interval
 		return x;
 	}
 
-	Interval expand(double delta) const
+	IntervalT expand(T delta) const
 	{
-		double padding = delta / 2;
-		return Interval(min - padding, max + padding);
+		T padding = delta / 2;
+		return IntervalT(min - padding, max + padding);
 	}
 
-	static const Interval empty, universe;
+	static const IntervalT empty, universe;
 };
 
-const Interval Interval::empty		= Interval(INF, -INF);
-const Interval Interval::universe	= Interval(-INF, INF);
+template<typename T>
+const IntervalT<T> IntervalT<T>::empty		= IntervalT<T>(T(INF), T(-INF));
+template<typename T>
+const IntervalT<T> IntervalT<T>::universe	= IntervalT<T>(T(-INF), T(INF));
+
+using Interval = IntervalT<Real>;
 
 #endif
\ No newline at end of file
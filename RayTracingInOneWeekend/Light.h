@@ -0,0 +1,151 @@
+#pragma once
+
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "Hittable.h"
+#include "MaterialTable.h"
+#include "Sampler.h"
+#include "SphereSet.h"
+
+#include <algorithm>
+#include <vector>
+
+struct SphereLight
+{
+	Point3 center;
+	Real radius;
+};
+
+struct LightSample
+{
+	Vec3 direction;		// unit vector from the shaded point towards the light
+	Real pdf;			// solid angle density of the direction, choice of light included
+	Real distance;		// the light's near side is no farther than this along direction, the centre is farther
+};
+
+class LightList
+{
+public:
+	// the emissive spheres of a scene, which next-event estimation aims its shadow rays at
+	// a light is picked uniformly, then a direction uniformly inside the cone its sphere subtends, so the density of
+	// any direction is the mean of the cone densities of the lights it points at
+	LightList() {}
+
+	LightList(const SphereSet& spheres, const MaterialTable& materials)
+	{
+		for (int s = 0; s < spheres.size(); s++)
+		{
+			if (!spheres.is_padding(s) && materials[spheres.material_id(s)].emits())
+				add(spheres.center(s), spheres.radius(s));
+		}
+	}
+
+	void add(const Point3& center, Real radius) { lights.push_back({ center, radius }); }
+
+	bool empty() const { return lights.empty(); }
+	int size() const { return int(lights.size()); }
+
+	bool sample(const Point3& origin, double select, const Sample2D& s, LightSample& result) const
+	{
+		// false when the picked light has no cone from origin, i.e. origin is inside it
+		const SphereLight& light = lights[std::min(int(select * lights.size()), size() - 1)];
+		Vec3 axis;
+		Real cone_size;
+		if (!cone(light, origin, axis, cone_size))
+			return false;
+
+		// cos theta uniform over [cos theta max, 1] is uniform in solid angle
+		Real cos_theta = 1 - Real(s.u) * cone_size;
+		Real sin_theta = std::sqrt(std::fmax(Real(0), 1 - cos_theta * cos_theta));
+		Real phi = Real(2 * PI * s.v);
+
+		// orthonormal basis around the axis (Duff et al. 2017)
+		Real sign = std::copysign(Real(1), axis.z());
+		Real a = -1 / (sign + axis.z());
+		Real b = axis.x() * axis.y() * a;
+		Vec3 tangent(1 + sign * axis.x() * axis.x() * a, sign * b, -sign * axis.x());
+		Vec3 bitangent(b, sign + axis.y() * axis.y() * a, -axis.y());
+
+		result.direction = cos_theta * axis + sin_theta * (std::cos(phi) * tangent + std::sin(phi) * bitangent);
+		result.distance = (light.center - origin).length();
+		result.pdf = pdf(origin, result.direction);
+		return result.pdf > 0;
+	}
+
+	Real pdf(const Point3& origin, const Vec3& direction) const
+	{
+		// direction is a unit vector, overlapping lights add up
+		Real sum = 0;
+		for (const SphereLight& light : lights)
+		{
+			Vec3 axis;
+			Real cone_size;
+			if (cone(light, origin, axis, cone_size) && dot(direction, axis) >= 1 - cone_size)
+				sum += 1 / (Real(2 * PI) * cone_size);
+		}
+		return lights.empty() ? 0 : sum / Real(lights.size());
+	}
+
+private:
+	std::vector<SphereLight> lights;
+
+	static bool cone(const SphereLight& light, const Point3& origin, Vec3& axis, Real& cone_size)
+	{
+		// the cone of directions from origin that hit the light, as its axis and 1 - cos theta max, computed without
+		// the cancellation that would round it to zero for small or distant lights
+		Vec3 to_center = light.center - origin;
+		Real distance_sq = to_center.length_squared();
+		Real radius_sq = light.radius * light.radius;
+		if (distance_sq <= radius_sq)
+			return false;
+
+		Real sin_sq = radius_sq / distance_sq;
+		cone_size = sin_sq / (1 + std::sqrt(1 - sin_sq));
+		axis = to_center / std::sqrt(distance_sq);
+		return true;
+	}
+};
+
+inline Real power_heuristic(Real pdf, Real other_pdf)
+{
+	// the multiple importance sampling weight of a sample drawn with pdf that a strategy with other_pdf could also draw
+	return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+}
+
+inline Real lambertian_pdf(const Vec3& normal, const Vec3& direction)
+{
+	// the density of scatter_lambertian's cosine weighted directions
+	return std::fmax(Real(0), dot(normal, unit_vector(direction))) / Real(PI);
+}
+
+inline Real scattered_light_weight(const LightList& lights, const Ray& r, Real scatter_pdf)
+{
+	// the weight of light that r, scattered with scatter_pdf, found on its own, 0 stands for a scatter no light
+	// sample could have matched, e.g. off a mirror or out of the camera
+	return scatter_pdf > 0 ? power_heuristic(scatter_pdf, lights.pdf(r.origin(), unit_vector(r.direction()))) : 1;
+}
+
+inline bool sample_light_ray(const LightList& lights, const HitRecord& rec, const Material& mat, int bounce,
+	Ray& shadow_ray, Real& distance, Color& weight)
+{
+	// a shadow ray from a diffuse hit towards a light, how far it needs tracing, and what the light it sees is
+	// multiplied by: the BRDF times the cosine over the light density, weighted against scattering at rec having found
+	// the same light
+	double select;
+	Sample2D s = light_sample(bounce, select);
+	LightSample light;
+	if (!lights.sample(rec.p, select, s, light))
+		return false;
+
+	Real scatter_pdf = lambertian_pdf(rec.normal, light.direction);
+	if (scatter_pdf <= 0)
+		return false;
+
+	shadow_ray = Ray(rec.p, light.direction);
+	distance = light.distance;
+	weight = mat.color() * (scatter_pdf * power_heuristic(light.pdf, scatter_pdf) / light.pdf);
+	return true;
+}
+
+#endif
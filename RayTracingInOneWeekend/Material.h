@@ -5,25 +5,52 @@
 
 struct HitRecord;
 
+enum class MaterialType
+{
+	Lambertian,
+	Metal,
+	Dielectric,
+	DiffuseLight,
+	Count
+};
+
 class Material
 {
 public:
-	virtual ~Material() = default;
+	// materials are plain values tagged with their type, scatter switches on the tag instead of going through a vtable
+	// the subclasses below only pick the type and parameters, so they can be stored by value in a MaterialTable
+
+	MaterialType type() const { return kind; }
+	const Color& color() const { return albedo; }
+	Real fuzziness() const { return fuzz; }
+	Real ior() const { return refraction_index; }
 
-	virtual bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const
+	bool emits() const { return kind == MaterialType::DiffuseLight; }
+
+	Color emitted(const HitRecord& rec) const
 	{
-		return false;
+		// lights shine from their front faces only and scatter nothing
+		return emits() && rec.front_face ? albedo : Color(0, 0, 0);
 	}
-};
 
-class Lambertian : public Material
-{
-public:
-	Lambertian(const Color& albedo) : albedo(albedo) {}
+	bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const
+	{
+		switch (kind)
+		{
+		case MaterialType::Lambertian:
+			return scatter_lambertian(r_in, rec, attenuation, r_out);
+		case MaterialType::Metal:
+			return scatter_metal(r_in, rec, attenuation, r_out);
+		case MaterialType::Dielectric:
+			return scatter_dielectric(r_in, rec, attenuation, r_out);
+		default:
+			return false;
+		}
+	}
 
-	bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const override
+	bool scatter_lambertian(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const
 	{
-		Vec3 scatter_direction = rec.normal + random_unit_vector();
+		Vec3 scatter_direction = rec.normal + sample_unit_vector();
 
 		// catch degenerate scatter direction
 		if (scatter_direction.near_zero())
@@ -34,47 +61,28 @@ public:
 		return true;
 	}
 
-private:
-	Color albedo;
-};
-
-class Metal : public Material
-{
-public:
-	Metal(const Color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
-
-	bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const override
+	bool scatter_metal(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const
 	{
 		Vec3 reflected = reflect(r_in.direction(), rec.normal);
-		reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+		reflected = unit_vector(reflected) + (fuzz * sample_unit_vector());
 		r_out = Ray(rec.p, reflected);
 		attenuation = albedo;
 		return (dot(r_out.direction(), rec.normal) > 0);
 	}
 
-private:
-	Color albedo;
-	double fuzz;
-};
-
-class Dielectric : public Material
-{
-public:
-	Dielectric(double refraction_index) : refraction_index(refraction_index) {}
-
-	bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const override
+	bool scatter_dielectric(const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& r_out) const
 	{
-		attenuation = Color(1.0, 1.0, 1.0);
-		double ri = rec.front_face ? (1.0 / refraction_index) : refraction_index;
+		attenuation = Color(1, 1, 1);
+		Real ri = rec.front_face ? (1 / refraction_index) : refraction_index;
 
 		Vec3 unit_dir = unit_vector(r_in.direction());
-		double cos_theta = fmin(dot(-unit_dir, rec.normal), 1.0);
-		double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+		Real cos_theta = std::fmin(dot(-unit_dir, rec.normal), Real(1));
+		Real sin_theta = std::sqrt(1 - cos_theta * cos_theta);
 
-		bool cannot_refract = ri * sin_theta > 1.0;
+		bool cannot_refract = ri * sin_theta > 1;
 		Vec3 dir;
 
-		if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+		if (cannot_refract || reflectance(cos_theta, ri) > sample_1d())
 		{
 			dir = reflect(unit_dir, rec.normal);
 		}
@@ -87,16 +95,48 @@ public:
 		return true;
 	}
 
+protected:
+	Material(MaterialType kind, const Color& albedo, Real fuzz, Real refraction_index)
+		: kind(kind), albedo(albedo), fuzz(fuzz), refraction_index(refraction_index) {}
+
 private:
-	double refraction_index;
+	MaterialType kind;
+	Color albedo;
+	Real fuzz;
+	Real refraction_index;
 
-	static double reflectance(double cosine, double refraction_index)
+	static Real reflectance(Real cosine, Real refraction_index)
 	{
 		// Schlick's approximation for reflectance
-		double r0 = (1 - refraction_index) / (1 + refraction_index);
+		Real r0 = (1 - refraction_index) / (1 + refraction_index);
 		r0 = r0 * r0;
-		return r0 + (1 - r0) * pow((1 - cosine), 5);
+		return r0 + (1 - r0) * std::pow((1 - cosine), 5);
 	}
 };
 
+class Lambertian : public Material
+{
+public:
+	Lambertian(const Color& albedo) : Material(MaterialType::Lambertian, albedo, 0, 1) {}
+};
+
+class Metal : public Material
+{
+public:
+	Metal(const Color& albedo, Real fuzz) : Material(MaterialType::Metal, albedo, fuzz < 1 ? fuzz : 1, 1) {}
+};
+
+class Dielectric : public Material
+{
+public:
+	Dielectric(Real refraction_index) : Material(MaterialType::Dielectric, Color(1, 1, 1), 0, refraction_index) {}
+};
+
+class DiffuseLight : public Material
+{
+public:
+	// emits the same radiance in every direction, color() is that radiance
+	DiffuseLight(const Color& emission) : Material(MaterialType::DiffuseLight, emission, 0, 1) {}
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include "Hittable.h"
+#include "Material.h"
+
+#include <vector>
+
+class MaterialTable
+{
+public:
+	// owns every material of a scene, geometry refers to them by the index add returns
+	// the table must outlive any render of the scene, nothing is reference counted per hit
+
+	int add(const Material& mat)
+	{
+		materials.push_back(mat);
+		return size() - 1;
+	}
+
+	const Material& operator[](int id) const { return materials[id]; }
+
+	int size() const { return int(materials.size()); }
+
+private:
+	std::vector<Material> materials;
+};
+
+#endif
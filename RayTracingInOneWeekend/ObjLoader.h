@@ -0,0 +1,209 @@
+#pragma once
+
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include "RTWeekend.h"
+
+#include "MappedFile.h"
+
+#include <climits>
+#include <string>
+#include <vector>
+
+class ObjParser
+{
+public:
+	// reads the vertex positions and faces of a Wavefront OBJ straight out of its mapped bytes, without copying lines
+	// into strings, polygons are split into triangle fans and every other statement (normals, uvs, groups) is skipped
+	ObjParser(const char* begin, const char* end) : p(begin), end(end) {}
+
+	bool parse(std::vector<Point3>& vertices, std::vector<int>& indices, std::string& error)
+	{
+		std::vector<int> face;
+		while (p < end)
+		{
+			skip_blanks();
+			if (p < end && *p == 'v' && p + 1 < end && is_blank(p[1]))
+			{
+				p++;
+				double x, y, z;
+				if (!number(x) || !number(y) || !number(z))
+					return fail(error, "malformed vertex");
+				vertices.push_back(Point3(Real(x), Real(y), Real(z)));
+			}
+			else if (p < end && *p == 'f' && p + 1 < end && is_blank(p[1]))
+			{
+				p++;
+				face.clear();
+				int index;
+				while (vertex_index(int(vertices.size()), index))
+					face.push_back(index);
+				if (face.size() < 3 || !at_line_end())
+					return fail(error, "malformed face");
+
+				for (size_t k = 2; k < face.size(); k++)
+				{
+					indices.push_back(face[0]);
+					indices.push_back(face[k - 1]);
+					indices.push_back(face[k]);
+				}
+			}
+			next_line();
+		}
+
+		vertices.shrink_to_fit();
+		indices.shrink_to_fit();
+		return true;
+	}
+
+private:
+	const char* p;
+	const char* end;
+	int line = 1;
+
+	bool fail(std::string& error, const std::string& message) const
+	{
+		error = "line " + std::to_string(line) + ": " + message;
+		return false;
+	}
+
+	static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+	void skip_blanks()
+	{
+		while (p < end && is_blank(*p))
+			p++;
+	}
+
+	bool at_line_end()
+	{
+		skip_blanks();
+		return p == end || *p == '\n' || *p == '#';
+	}
+
+	void next_line()
+	{
+		while (p < end && *p != '\n')
+			p++;
+		if (p < end)
+		{
+			p++;
+			line++;
+		}
+	}
+
+	bool number(double& value)
+	{
+		// [sign] digits [. digits] [e [sign] digits], parsed by hand since strtod needs a terminating null
+		skip_blanks();
+		bool negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+'))
+			p++;
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+		for (; p < end && is_digit(*p); p++, digits++)
+		{
+			if (mantissa < 100000000000000000ULL)
+				mantissa = 10 * mantissa + (*p - '0');
+			else
+				exponent++;
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && is_digit(*p); p++, digits++)
+			{
+				if (mantissa < 100000000000000000ULL)
+				{
+					mantissa = 10 * mantissa + (*p - '0');
+					exponent--;
+				}
+			}
+		}
+		if (digits == 0)
+			return false;
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negative_exponent = p < end && *p == '-';
+			if (p < end && (*p == '-' || *p == '+'))
+				p++;
+			if (p == end || !is_digit(*p))
+				return false;
+
+			int e = 0;
+			for (; p < end && is_digit(*p); p++)
+				e = e < 10000 ? 10 * e + (*p - '0') : e;
+			exponent += negative_exponent ? -e : e;
+		}
+
+		// dividing by an exact power of ten rounds once, multiplying by an inexact negative power would round twice
+		value = exponent < 0 ? double(mantissa) / power_of_ten(-exponent) : double(mantissa) * power_of_ten(exponent);
+		if (negative)
+			value = -value;
+		return true;
+	}
+
+	static double power_of_ten(int e)
+	{
+		// exact up to 1e22, which covers every number an exporter writes with fixed notation
+		static const double table[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		return e <= 22 ? table[e] : std::pow(10.0, e);
+	}
+
+	bool vertex_index(int vertex_count, int& index)
+	{
+		// the position part of v, v/vt, v//vn or v/vt/vn, negative indices count back from the latest vertex
+		skip_blanks();
+		bool negative = p < end && *p == '-';
+		if (negative)
+			p++;
+		if (p == end || !is_digit(*p))
+			return false;
+
+		long long value = 0;
+		for (; p < end && is_digit(*p); p++)
+			value = value < INT_MAX ? 10 * value + (*p - '0') : value;
+		while (p < end && !is_blank(*p) && *p != '\n' && *p != '#')
+			p++;
+
+		long long resolved = negative ? vertex_count - value : value - 1;
+		if (value == 0 || resolved < 0 || resolved >= vertex_count)
+			return false;
+		index = int(resolved);
+		return true;
+	}
+};
+
+inline bool load_obj(const std::string& path, std::vector<Point3>& vertices, std::vector<int>& indices)
+{
+	MappedFile file;
+	std::string error = "cannot open file";
+	bool loaded = false;
+
+	vertices.clear();
+	indices.clear();
+	if (file.open(path))
+	{
+		const char* text = (const char*)file.data();
+		loaded = ObjParser(text, text + file.size()).parse(vertices, indices, error);
+	}
+
+	// a file of bare vertices parses fine but leaves nothing to intersect or to frame
+	if (loaded && indices.empty())
+	{
+		error = "no faces";
+		loaded = false;
+	}
+
+	if (!loaded)
+		std::clog << "Failed to load " << path << ": " << error << "\n";
+	return loaded;
+}
+
+#endif
@@ -0,0 +1,177 @@
+#pragma once
+
+#ifndef PARTIAL_BUFFER_H
+#define PARTIAL_BUFFER_H
+
+#include "Framebuffer.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// a partial buffer holds one share of a distributed render: the raw sample sums and counts of a band of rows, for a
+// range of samples per pixel, so shares rendered by separate processes can be added up into the final image,
+// render checkpoints are partial buffers of the samples taken so far
+
+struct PartialRange
+{
+	int first_row, end_row;			// rows [first_row, end_row) are stored
+	int first_sample, end_sample;	// the samples of each pixel they hold
+	uint32_t settings_hash = 0;		// Camera::settings_hash of the render, 0 if unknown
+};
+
+// binary layout, little endian: the header, then one PartialPixel for every pixel of rows [first_row, end_row)
+struct PartialBufferHeader
+{
+	char magic[8];
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t first_row;
+	int32_t end_row;
+	int32_t first_sample;
+	int32_t end_sample;
+	uint32_t settings_hash;
+};
+
+struct PartialPixel
+{
+	float sum[3];
+	float luminance_sq_sum;
+	int32_t count;
+};
+
+static_assert(sizeof(PartialBufferHeader) == 40, "partial buffer header must match the file layout");
+static_assert(sizeof(PartialPixel) == 20, "partial pixel must match the file layout");
+
+static const char PARTIAL_BUFFER_MAGIC[8] = { 'R', 'T', 'P', 'A', 'R', 'T', 0, 0 };
+static const uint32_t PARTIAL_BUFFER_VERSION = 1;
+
+inline bool ranges_overlap(const PartialRange& a, const PartialRange& b)
+{
+	// two shares count some samples twice if they have rows and samples in common
+	return a.first_row < b.end_row && b.first_row < a.end_row
+		&& a.first_sample < b.end_sample && b.first_sample < a.end_sample;
+}
+
+inline bool write_partial(const Framebuffer& fb, const PartialRange& range, const std::string& path)
+{
+	if (!host_is_little_endian())
+		return false;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	PartialBufferHeader header = {};
+	std::memcpy(header.magic, PARTIAL_BUFFER_MAGIC, sizeof(header.magic));
+	header.version = PARTIAL_BUFFER_VERSION;
+	header.width = fb.width();
+	header.height = fb.height();
+	header.first_row = range.first_row;
+	header.end_row = range.end_row;
+	header.first_sample = range.first_sample;
+	header.end_sample = range.end_sample;
+	header.settings_hash = range.settings_hash;
+	file.write((const char*)&header, sizeof(header));
+
+	std::vector<PartialPixel> row(fb.width());
+	for (int j = range.first_row; j < range.end_row; j++)
+	{
+		for (int i = 0; i < fb.width(); i++)
+		{
+			Color sum = fb.sample_sum(i, j);
+			row[i] = { { float(sum.x()), float(sum.y()), float(sum.z()) }, float(fb.luminance_sq_sum(i, j)), fb.sample_count(i, j) };
+		}
+		file.write((const char*)row.data(), row.size() * sizeof(PartialPixel));
+	}
+	return bool(file);
+}
+
+inline bool parse_partial(const unsigned char* data, size_t size, Framebuffer& fb, PartialRange& range, std::string& error)
+{
+	PartialBufferHeader header;
+	if (size < sizeof(header))
+	{
+		error = "truncated header";
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.magic, PARTIAL_BUFFER_MAGIC, sizeof(header.magic)) != 0)
+	{
+		error = "not a partial buffer";
+		return false;
+	}
+	if (header.version != PARTIAL_BUFFER_VERSION)
+	{
+		error = "unsupported version " + std::to_string(header.version);
+		return false;
+	}
+	if (!host_is_little_endian())
+	{
+		error = "partial buffers can only be read on little endian hosts";
+		return false;
+	}
+	if (header.width < 1 || header.height < 1 || header.first_row < 0 || header.first_row > header.end_row
+		|| header.end_row > header.height || header.first_sample < 0 || header.first_sample > header.end_sample)
+	{
+		error = "invalid size or range";
+		return false;
+	}
+	if (fb.width() != 0 && (fb.width() != header.width || fb.height() != header.height))
+	{
+		error = "image size " + std::to_string(header.width) + "x" + std::to_string(header.height)
+			+ " does not match " + std::to_string(fb.width()) + "x" + std::to_string(fb.height());
+		return false;
+	}
+
+	const size_t pixel_count = size_t(header.width) * (header.end_row - header.first_row);
+	if (size < sizeof(header) + pixel_count * sizeof(PartialPixel))
+	{
+		error = "truncated data";
+		return false;
+	}
+
+	if (fb.width() == 0)
+		fb.resize(header.width, header.height);
+
+	const unsigned char* pixels = data + sizeof(header);
+	for (int j = header.first_row; j < header.end_row; j++)
+	{
+		for (int i = 0; i < header.width; i++)
+		{
+			PartialPixel pixel;
+			std::memcpy(&pixel, pixels, sizeof(pixel));
+			pixels += sizeof(pixel);
+
+			if (pixel.count > 0)
+				fb.add_samples(i, j, Color(pixel.sum[0], pixel.sum[1], pixel.sum[2]), pixel.luminance_sq_sum, pixel.count);
+		}
+	}
+
+	range = { header.first_row, header.end_row, header.first_sample, header.end_sample, header.settings_hash };
+	return true;
+}
+
+inline bool load_partial(const std::string& path, Framebuffer& fb, PartialRange& range)
+{
+	// adds the partial's samples to fb, which is sized to the partial's image if it is still empty
+	MappedFile file;
+	std::string error;
+	bool loaded = false;
+
+	if (!file.open(path))
+		error = "cannot open file";
+	else
+		loaded = parse_partial(file.data(), file.size(), fb, range, error);
+
+	if (!loaded)
+		std::clog << "Failed to load " << path << ": " << error << "\n";
+	return loaded;
+}
+
+#endif
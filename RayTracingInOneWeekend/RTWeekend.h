@@ -4,23 +4,118 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <memory>
 
+// geometry and shading run in Real, define RT_SINGLE_PRECISION to build them in float instead of double
+#ifdef RT_SINGLE_PRECISION
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
 const double INF = std::numeric_limits<double>::infinity();
 const double PI = 3.1415926535897932385;
 
+template<typename T>
+struct Epsilon;
+
+template<>
+struct Epsilon<double>
+{
+	static double ray_t_min() { return 0.001; }		// closest accepted hit, keeps scattered rays off their own surface
+	static double near_zero() { return 1e-8; }
+};
+
+template<>
+struct Epsilon<float>
+{
+	// rounding in float leaves hit points further from the surface, so both tolerances are wider
+	static float ray_t_min() { return 0.01f; }
+	static float near_zero() { return 1e-5f; }
+};
+
 inline double degrees_to_radians(double degrees)
 {
 	return degrees * PI / 180.0;
 }
 
+class PCG32
+{
+public:
+	PCG32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+
+	void seed(uint64_t initstate, uint64_t initseq)
+	{
+		state = 0;
+		inc = (initseq << 1u) | 1u;
+		next();
+		state += initstate;
+		next();
+	}
+
+	uint32_t next()
+	{
+		uint64_t oldstate = state;
+		state = oldstate * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = uint32_t(((oldstate >> 18u) ^ oldstate) >> 27u);
+		uint32_t rot = uint32_t(oldstate >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+	}
+
+private:
+	uint64_t state;
+	uint64_t inc;
+};
+
+inline uint64_t mix_bits(uint64_t v)
+{
+	// splitmix64 finaliser, spreads nearby keys such as neighbouring pixel indices across the whole state
+	v += 0x9e3779b97f4a7c15ULL;
+	v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+	return v ^ (v >> 31);
+}
+
+inline bool host_is_little_endian()
+{
+	// the binary formats are written in host byte order, which PFM records and the others only read back when little endian
+	const uint32_t one = 1;
+	unsigned char first_byte;
+	std::memcpy(&first_byte, &one, 1);
+	return first_byte == 1;
+}
+
+inline uint32_t fnv1a(const void* data, size_t size, uint32_t hash = 2166136261u)
+{
+	// FNV-1a, passing the previous result as hash carries on over several arrays as if they were one
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+inline PCG32& thread_rng()
+{
+	// every thread owns its generator, so sampling never touches shared state
+	thread_local PCG32 rng;
+	return rng;
+}
+
+inline void seed_random(uint64_t seed, uint64_t sequence)
+{
+	// reseeds the calling thread's generator, e.g. with a pixel and sample index so results don't depend on scheduling
+	thread_rng().seed(mix_bits(seed), mix_bits(sequence));
+}
+
 inline double random_double()
 {
 	// returns real number between in [0, 1)
-	return rand() / (RAND_MAX + 1.0);
+	return thread_rng().next() * (1.0 / 4294967296.0);
 }
 
 inline double random_double(double min, double max)
@@ -28,9 +123,11 @@ inline double random_double(double min, double max)
 	return min + (max - min) * random_double();
 }
 
+#include "RenderStats.h"
 #include "Interval.h"
 #include "Vec3.h"
 #include "Color.h"
 #include "Ray.h"
+#include "Sampler.h"
 
 #endif
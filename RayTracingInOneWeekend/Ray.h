@@ -3,22 +3,36 @@
 #ifndef RAY_H
 #define RAY_H
 
-class Ray {
+template<typename T>
+class RayT {
 public:
-	Ray() {}
-	Ray(const Point3& origin, const Vec3 direction) : orig(origin), dir(direction) {}
+	RayT() {}
+	RayT(const Vec3T<T>& origin, const Vec3T<T> direction)
+		: orig(origin), dir(direction), inv_dir(1 / direction[0], 1 / direction[1], 1 / direction[2])
+	{
+		// a zero component divides to +/-INF, which the slab tests rely on
+		dir_sign[0] = inv_dir[0] < 0;
+		dir_sign[1] = inv_dir[1] < 0;
+		dir_sign[2] = inv_dir[2] < 0;
+	}
 
-	const Point3& origin() const { return orig; }
-	const Vec3& direction() const { return dir; }
+	const Vec3T<T>& origin() const { return orig; }
+	const Vec3T<T>& direction() const { return dir; }
+	const Vec3T<T>& inverse_direction() const { return inv_dir; }
+	int sign(int axis) const { return dir_sign[axis]; }
 
-	Point3 at(double t) const
+	Vec3T<T> at(T t) const
 	{
 		return orig + t * dir;
 	}
 
 private:
-	Point3 orig;
-	Vec3 dir;
+	Vec3T<T> orig;
+	Vec3T<T> dir;
+	Vec3T<T> inv_dir;
+	int dir_sign[3] = { 0, 0, 0 };
 };
 
+using Ray = RayT<Real>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "RTWeekend.h"
+#include "SIMD.h"
+
+struct RayPacket
+{
+	// up to MAX_SIZE rays traced together, kernels work through them a group of GROUP lanes (one Real4) at a time
+	static const int MAX_SIZE = 16;
+	static const int GROUP = 4;
+
+	int size = GROUP;		// a multiple of GROUP, lanes from size on are never in a lane mask
+
+	// SoA copies of the lane rays so that SIMD kernels can load one component of a group of lanes at once
+	alignas(32) Real orig[3][MAX_SIZE];
+	alignas(32) Real dir[3][MAX_SIZE];
+	alignas(32) Real inv_dir[3][MAX_SIZE];
+
+	Ray rays[MAX_SIZE];
+
+	static int lane_count(int lane_mask)
+	{
+		int count = 0;
+		for (; lane_mask != 0; lane_mask &= lane_mask - 1)
+			count++;
+		return count;
+	}
+
+	static int group_mask(int lane_mask, int group)
+	{
+		// the lanes of one group as the low GROUP bits
+		return (lane_mask >> (GROUP * group)) & ((1 << GROUP) - 1);
+	}
+
+	int groups() const { return size / GROUP; }
+
+	void set(int lane, const Ray& r)
+	{
+		rays[lane] = r;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			orig[axis][lane] = r.origin()[axis];
+			dir[axis][lane] = r.direction()[axis];
+			inv_dir[axis][lane] = r.inverse_direction()[axis];
+		}
+	}
+
+	void clear()
+	{
+		// unused lanes still hold finite values so they never produce floating point exceptions
+		for (int lane = 0; lane < MAX_SIZE; lane++)
+			set(lane, Ray(Point3(0, 0, 0), Vec3(1, 1, 1)));
+	}
+
+	int box_hit_mask(const Real* lo, const Real* hi, Real t_min, const Real* t_max, int lane_mask) const
+	{
+		// slab test of one box against every lane, lo and hi hold the box's x, y and z bounds
+		RT_STAT(box_tests += lane_count(lane_mask));
+
+		int hit_mask = 0;
+		for (int g = 0; g < groups(); g++)
+		{
+			const int lanes = group_mask(lane_mask, g);
+			if (lanes == 0)
+				continue;
+
+			const int first = GROUP * g;
+			Real4 t_near = Real4::broadcast(t_min);
+			Real4 t_far = Real4::load(t_max + first);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const Real4 o = Real4::load(orig[axis] + first);
+				const Real4 inv = Real4::load(inv_dir[axis] + first);
+				const Real4 t0 = (Real4::broadcast(lo[axis]) - o) * inv;
+				const Real4 t1 = (Real4::broadcast(hi[axis]) - o) * inv;
+				t_near = max(t_near, min(t0, t1));
+				t_far = min(t_far, max(t0, t1));
+			}
+			hit_mask |= (less_than(t_near, t_far) & lanes) << first;
+		}
+		return hit_mask;
+	}
+};
+
+#endif
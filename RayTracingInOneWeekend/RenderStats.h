@@ -0,0 +1,182 @@
+#pragma once
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// hot-path counters, kept per thread so that counting never touches shared cache lines
+// define RT_DISABLE_STATS to compile every RT_STAT out of the renderer
+
+enum class PathEnd
+{
+	Miss,			// left the scene and picked up the sky
+	Absorbed,		// a material declined to scatter, e.g. a Metal reflection below the surface
+	DepthCap,		// ran out of bounces at max_depth
+	Roulette,		// terminated by Russian roulette
+	Light,			// hit a light, which scatters nothing
+	Count
+};
+
+struct RenderStats
+{
+	static const int PATH_LENGTH_BUCKETS = 65;		// rays traced per path, the last bucket also counts longer paths
+
+	uint64_t camera_rays = 0;
+	uint64_t rays = 0;					// every ray intersected with the scene, camera rays included
+	uint64_t shadow_rays = 0;			// rays traced towards lights by next-event estimation, also counted in rays
+	uint64_t sphere_tests = 0;			// ray-sphere quadratics, SIMD lanes counted one by one
+	uint64_t triangle_tests = 0;		// ray-triangle tests, SIMD lanes counted one by one
+	uint64_t box_tests = 0;				// ray-box slab tests, SIMD lanes counted one by one
+	uint64_t bvh_nodes = 0;				// interior nodes visited by BVH traversals
+	uint64_t instance_tests = 0;		// rays taken into the object space of an Instance
+	uint64_t path_ends[int(PathEnd::Count)] = {};
+	uint64_t path_lengths[PATH_LENGTH_BUCKETS] = {};
+
+	double busy_seconds = 0;			// time the worker spent rendering tiles
+
+	void end_path(PathEnd reason, int length)
+	{
+		path_ends[int(reason)]++;
+		path_lengths[length < PATH_LENGTH_BUCKETS - 1 ? length : PATH_LENGTH_BUCKETS - 1]++;
+	}
+
+	void add(const RenderStats& other)
+	{
+		camera_rays += other.camera_rays;
+		rays += other.rays;
+		shadow_rays += other.shadow_rays;
+		sphere_tests += other.sphere_tests;
+		triangle_tests += other.triangle_tests;
+		box_tests += other.box_tests;
+		bvh_nodes += other.bvh_nodes;
+		instance_tests += other.instance_tests;
+		for (int i = 0; i < int(PathEnd::Count); i++)
+			path_ends[i] += other.path_ends[i];
+		for (int i = 0; i < PATH_LENGTH_BUCKETS; i++)
+			path_lengths[i] += other.path_lengths[i];
+		busy_seconds += other.busy_seconds;
+	}
+};
+
+inline RenderStats& thread_stats()
+{
+	thread_local RenderStats stats;
+	return stats;
+}
+
+#ifdef RT_DISABLE_STATS
+	#define RT_STAT(statement)
+#else
+	#define RT_STAT(statement) do { thread_stats().statement; } while (0)
+#endif
+
+inline bool render_stats_enabled()
+{
+#ifdef RT_DISABLE_STATS
+	return false;
+#else
+	return true;
+#endif
+}
+
+inline void print_render_stats(std::ostream& out, const std::vector<RenderStats>& workers, double wall_seconds)
+{
+	RenderStats total;
+	for (const RenderStats& w : workers)
+		total.add(w);
+
+	out << "Render time: " << wall_seconds << " s on " << workers.size() << " workers\n";
+
+	// efficiency is the share of the wall time a worker spent on tiles rather than waiting for the others
+	double efficiency = wall_seconds > 0 ? total.busy_seconds / (wall_seconds * workers.size()) : 0;
+	out << "Parallel efficiency: " << std::fixed << std::setprecision(1) << 100 * efficiency << "%\n";
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		const RenderStats& w = workers[i];
+		out << "  worker " << i << ": " << std::setprecision(3) << w.busy_seconds << " s busy";
+		if (render_stats_enabled())
+			out << ", " << std::setprecision(2) << w.rays / (w.busy_seconds > 0 ? w.busy_seconds : 1) / 1e6 << " Mrays/s";
+		out << "\n";
+	}
+
+	if (!render_stats_enabled())
+	{
+		out << "Ray statistics were compiled out (RT_DISABLE_STATS)\n";
+		out << std::defaultfloat;
+		return;
+	}
+
+	double rays = total.rays > 0 ? double(total.rays) : 1;
+	out << "Rays: " << total.rays << " (" << total.camera_rays << " camera, " << total.shadow_rays << " shadow), "
+		<< std::setprecision(2) << total.rays / wall_seconds / 1e6 << " Mrays/s\n";
+	out << "Per ray: " << total.bvh_nodes / rays << " BVH nodes, " << total.box_tests / rays << " box tests, "
+		<< total.sphere_tests / rays << " sphere tests, " << total.triangle_tests / rays << " triangle tests, "
+		<< total.instance_tests / rays << " instance tests\n";
+
+	uint64_t paths = 0;
+	for (uint64_t n : total.path_ends)
+		paths += n;
+	double path_count = paths > 0 ? double(paths) : 1;
+	out << "Paths: " << paths << ", ended by miss " << std::setprecision(1)
+		<< 100 * total.path_ends[int(PathEnd::Miss)] / path_count << "%, absorbed "
+		<< 100 * total.path_ends[int(PathEnd::Absorbed)] / path_count << "%, depth cap "
+		<< 100 * total.path_ends[int(PathEnd::DepthCap)] / path_count << "%, roulette "
+		<< 100 * total.path_ends[int(PathEnd::Roulette)] / path_count << "%, light "
+		<< 100 * total.path_ends[int(PathEnd::Light)] / path_count << "%\n";
+
+	out << "Path lengths:";
+	for (int i = 0; i < RenderStats::PATH_LENGTH_BUCKETS; i++)
+	{
+		if (total.path_lengths[i] > 0)
+			out << " " << i << (i == RenderStats::PATH_LENGTH_BUCKETS - 1 ? "+" : "") << ":" << total.path_lengths[i];
+	}
+	out << "\n" << std::defaultfloat;
+}
+
+inline void write_render_stats_json(std::ostream& out, const std::vector<RenderStats>& workers, double wall_seconds)
+{
+	RenderStats total;
+	for (const RenderStats& w : workers)
+		total.add(w);
+
+	out << "{\n";
+	out << "  \"stats_enabled\": " << (render_stats_enabled() ? "true" : "false") << ",\n";
+	out << "  \"wall_seconds\": " << wall_seconds << ",\n";
+	out << "  \"camera_rays\": " << total.camera_rays << ",\n";
+	out << "  \"rays\": " << total.rays << ",\n";
+	out << "  \"shadow_rays\": " << total.shadow_rays << ",\n";
+	out << "  \"rays_per_second\": " << (wall_seconds > 0 ? total.rays / wall_seconds : 0) << ",\n";
+	out << "  \"sphere_tests\": " << total.sphere_tests << ",\n";
+	out << "  \"triangle_tests\": " << total.triangle_tests << ",\n";
+	out << "  \"box_tests\": " << total.box_tests << ",\n";
+	out << "  \"bvh_nodes\": " << total.bvh_nodes << ",\n";
+	out << "  \"instance_tests\": " << total.instance_tests << ",\n";
+	out << "  \"path_ends\": { \"miss\": " << total.path_ends[int(PathEnd::Miss)]
+		<< ", \"absorbed\": " << total.path_ends[int(PathEnd::Absorbed)]
+		<< ", \"depth_cap\": " << total.path_ends[int(PathEnd::DepthCap)]
+		<< ", \"roulette\": " << total.path_ends[int(PathEnd::Roulette)]
+		<< ", \"light\": " << total.path_ends[int(PathEnd::Light)] << " },\n";
+
+	out << "  \"path_lengths\": [";
+	for (int i = 0; i < RenderStats::PATH_LENGTH_BUCKETS; i++)
+		out << (i ? ", " : "") << total.path_lengths[i];
+	out << "],\n";
+
+	out << "  \"workers\": [\n";
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		const RenderStats& w = workers[i];
+		out << "    { \"busy_seconds\": " << w.busy_seconds
+			<< ", \"efficiency\": " << (wall_seconds > 0 ? w.busy_seconds / wall_seconds : 0)
+			<< ", \"rays\": " << w.rays
+			<< ", \"rays_per_second\": " << (w.busy_seconds > 0 ? w.rays / w.busy_seconds : 0) << " }"
+			<< (i + 1 < workers.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+}
+
+#endif
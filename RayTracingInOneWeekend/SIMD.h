@@ -0,0 +1,435 @@
+#pragma once
+
+#ifndef SIMD_H
+#define SIMD_H
+
+// thin wrappers over four double lanes, backed by AVX, SSE2 or plain scalar code depending on the target,
+// and over four float lanes, backed by SSE or plain scalar code
+
+#if defined(__AVX__)
+	#define RT_SIMD_AVX
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define RT_SIMD_SSE2
+	#include <emmintrin.h>
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+struct Double4
+{
+#if defined(RT_SIMD_AVX)
+	__m256d v;
+#elif defined(RT_SIMD_SSE2)
+	__m128d lo, hi;
+#else
+	double e[4];
+#endif
+
+	static Double4 load(const double* p)
+	{
+		Double4 r;
+#if defined(RT_SIMD_AVX)
+		r.v = _mm256_loadu_pd(p);
+#elif defined(RT_SIMD_SSE2)
+		r.lo = _mm_loadu_pd(p);
+		r.hi = _mm_loadu_pd(p + 2);
+#else
+		for (int i = 0; i < 4; i++) r.e[i] = p[i];
+#endif
+		return r;
+	}
+
+	static Double4 broadcast(double x)
+	{
+		Double4 r;
+#if defined(RT_SIMD_AVX)
+		r.v = _mm256_set1_pd(x);
+#elif defined(RT_SIMD_SSE2)
+		r.lo = r.hi = _mm_set1_pd(x);
+#else
+		for (int i = 0; i < 4; i++) r.e[i] = x;
+#endif
+		return r;
+	}
+
+	void store(double* p) const
+	{
+#if defined(RT_SIMD_AVX)
+		_mm256_storeu_pd(p, v);
+#elif defined(RT_SIMD_SSE2)
+		_mm_storeu_pd(p, lo);
+		_mm_storeu_pd(p + 2, hi);
+#else
+		for (int i = 0; i < 4; i++) p[i] = e[i];
+#endif
+	}
+};
+
+#if defined(RT_SIMD_AVX)
+	#define RT_SIMD_BINARY_OP(name, avx, sse, scalar)					\
+		inline Double4 name(const Double4& a, const Double4& b)			\
+		{ Double4 r; r.v = avx(a.v, b.v); return r; }
+#elif defined(RT_SIMD_SSE2)
+	#define RT_SIMD_BINARY_OP(name, avx, sse, scalar)					\
+		inline Double4 name(const Double4& a, const Double4& b)			\
+		{ Double4 r; r.lo = sse(a.lo, b.lo); r.hi = sse(a.hi, b.hi); return r; }
+#else
+	#define RT_SIMD_BINARY_OP(name, avx, sse, scalar)					\
+		inline Double4 name(const Double4& a, const Double4& b)			\
+		{ Double4 r; for (int i = 0; i < 4; i++) { double x = a.e[i], y = b.e[i]; r.e[i] = (scalar); } return r; }
+#endif
+
+RT_SIMD_BINARY_OP(operator+, _mm256_add_pd, _mm_add_pd, x + y)
+RT_SIMD_BINARY_OP(operator-, _mm256_sub_pd, _mm_sub_pd, x - y)
+RT_SIMD_BINARY_OP(operator*, _mm256_mul_pd, _mm_mul_pd, x * y)
+RT_SIMD_BINARY_OP(operator/, _mm256_div_pd, _mm_div_pd, x / y)
+RT_SIMD_BINARY_OP(min, _mm256_min_pd, _mm_min_pd, x < y ? x : y)
+RT_SIMD_BINARY_OP(max, _mm256_max_pd, _mm_max_pd, x > y ? x : y)
+
+#undef RT_SIMD_BINARY_OP
+
+inline Double4 sqrt(const Double4& a)
+{
+	Double4 r;
+#if defined(RT_SIMD_AVX)
+	r.v = _mm256_sqrt_pd(a.v);
+#elif defined(RT_SIMD_SSE2)
+	r.lo = _mm_sqrt_pd(a.lo);
+	r.hi = _mm_sqrt_pd(a.hi);
+#else
+	for (int i = 0; i < 4; i++) r.e[i] = std::sqrt(a.e[i]);
+#endif
+	return r;
+}
+
+// lane masks keep every bit of a lane set where a comparison held, so they can drive select()
+
+inline Double4 compare_less(const Double4& a, const Double4& b)
+{
+	Double4 r;
+#if defined(RT_SIMD_AVX)
+	r.v = _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ);
+#elif defined(RT_SIMD_SSE2)
+	r.lo = _mm_cmplt_pd(a.lo, b.lo);
+	r.hi = _mm_cmplt_pd(a.hi, b.hi);
+#else
+	const uint64_t ones = ~uint64_t(0), zero = 0;
+	for (int i = 0; i < 4; i++) std::memcpy(&r.e[i], a.e[i] < b.e[i] ? &ones : &zero, sizeof(double));
+#endif
+	return r;
+}
+
+inline Double4 compare_less_equal(const Double4& a, const Double4& b)
+{
+	Double4 r;
+#if defined(RT_SIMD_AVX)
+	r.v = _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ);
+#elif defined(RT_SIMD_SSE2)
+	r.lo = _mm_cmple_pd(a.lo, b.lo);
+	r.hi = _mm_cmple_pd(a.hi, b.hi);
+#else
+	const uint64_t ones = ~uint64_t(0), zero = 0;
+	for (int i = 0; i < 4; i++) std::memcpy(&r.e[i], a.e[i] <= b.e[i] ? &ones : &zero, sizeof(double));
+#endif
+	return r;
+}
+
+inline Double4 operator&(const Double4& a, const Double4& b)
+{
+	Double4 r;
+#if defined(RT_SIMD_AVX)
+	r.v = _mm256_and_pd(a.v, b.v);
+#elif defined(RT_SIMD_SSE2)
+	r.lo = _mm_and_pd(a.lo, b.lo);
+	r.hi = _mm_and_pd(a.hi, b.hi);
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		uint64_t x, y;
+		std::memcpy(&x, &a.e[i], sizeof(double));
+		std::memcpy(&y, &b.e[i], sizeof(double));
+		x &= y;
+		std::memcpy(&r.e[i], &x, sizeof(double));
+	}
+#endif
+	return r;
+}
+
+inline Double4 select(const Double4& mask, const Double4& a, const Double4& b)
+{
+	// a where mask is set, b elsewhere
+	Double4 r;
+#if defined(RT_SIMD_AVX)
+	r.v = _mm256_blendv_pd(b.v, a.v, mask.v);
+#elif defined(RT_SIMD_SSE2)
+	r.lo = _mm_or_pd(_mm_and_pd(mask.lo, a.lo), _mm_andnot_pd(mask.lo, b.lo));
+	r.hi = _mm_or_pd(_mm_and_pd(mask.hi, a.hi), _mm_andnot_pd(mask.hi, b.hi));
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		uint64_t m;
+		std::memcpy(&m, &mask.e[i], sizeof(double));
+		r.e[i] = m ? a.e[i] : b.e[i];
+	}
+#endif
+	return r;
+}
+
+inline int movemask(const Double4& mask)
+{
+#if defined(RT_SIMD_AVX)
+	return _mm256_movemask_pd(mask.v);
+#elif defined(RT_SIMD_SSE2)
+	return _mm_movemask_pd(mask.lo) | (_mm_movemask_pd(mask.hi) << 2);
+#else
+	int bits = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uint64_t m;
+		std::memcpy(&m, &mask.e[i], sizeof(double));
+		bits |= (m != 0) << i;
+	}
+	return bits;
+#endif
+}
+
+// comparisons return a bit mask with bit i set when the comparison holds in lane i
+
+inline int less_than(const Double4& a, const Double4& b)
+{
+#if defined(RT_SIMD_AVX)
+	return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ));
+#elif defined(RT_SIMD_SSE2)
+	return _mm_movemask_pd(_mm_cmplt_pd(a.lo, b.lo)) | (_mm_movemask_pd(_mm_cmplt_pd(a.hi, b.hi)) << 2);
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; i++) mask |= (a.e[i] < b.e[i]) << i;
+	return mask;
+#endif
+}
+
+inline int less_equal(const Double4& a, const Double4& b)
+{
+#if defined(RT_SIMD_AVX)
+	return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ));
+#elif defined(RT_SIMD_SSE2)
+	return _mm_movemask_pd(_mm_cmple_pd(a.lo, b.lo)) | (_mm_movemask_pd(_mm_cmple_pd(a.hi, b.hi)) << 2);
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; i++) mask |= (a.e[i] <= b.e[i]) << i;
+	return mask;
+#endif
+}
+
+struct Float4
+{
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	__m128 v;
+#else
+	float e[4];
+#endif
+
+	static Float4 load(const float* p)
+	{
+		Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+		r.v = _mm_loadu_ps(p);
+#else
+		for (int i = 0; i < 4; i++) r.e[i] = p[i];
+#endif
+		return r;
+	}
+
+	static Float4 broadcast(float x)
+	{
+		Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+		r.v = _mm_set1_ps(x);
+#else
+		for (int i = 0; i < 4; i++) r.e[i] = x;
+#endif
+		return r;
+	}
+
+	void store(float* p) const
+	{
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+		_mm_storeu_ps(p, v);
+#else
+		for (int i = 0; i < 4; i++) p[i] = e[i];
+#endif
+	}
+};
+
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	#define RT_SIMD_BINARY_OP(name, sse, scalar)						\
+		inline Float4 name(const Float4& a, const Float4& b)			\
+		{ Float4 r; r.v = sse(a.v, b.v); return r; }
+#else
+	#define RT_SIMD_BINARY_OP(name, sse, scalar)						\
+		inline Float4 name(const Float4& a, const Float4& b)			\
+		{ Float4 r; for (int i = 0; i < 4; i++) { float x = a.e[i], y = b.e[i]; r.e[i] = (scalar); } return r; }
+#endif
+
+RT_SIMD_BINARY_OP(operator+, _mm_add_ps, x + y)
+RT_SIMD_BINARY_OP(operator-, _mm_sub_ps, x - y)
+RT_SIMD_BINARY_OP(operator*, _mm_mul_ps, x * y)
+RT_SIMD_BINARY_OP(operator/, _mm_div_ps, x / y)
+RT_SIMD_BINARY_OP(min, _mm_min_ps, x < y ? x : y)
+RT_SIMD_BINARY_OP(max, _mm_max_ps, x > y ? x : y)
+
+#undef RT_SIMD_BINARY_OP
+
+inline Float4 sqrt(const Float4& a)
+{
+	Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	r.v = _mm_sqrt_ps(a.v);
+#else
+	for (int i = 0; i < 4; i++) r.e[i] = std::sqrt(a.e[i]);
+#endif
+	return r;
+}
+
+inline Float4 compare_less(const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	r.v = _mm_cmplt_ps(a.v, b.v);
+#else
+	const uint32_t ones = ~uint32_t(0), zero = 0;
+	for (int i = 0; i < 4; i++) std::memcpy(&r.e[i], a.e[i] < b.e[i] ? &ones : &zero, sizeof(float));
+#endif
+	return r;
+}
+
+inline Float4 compare_less_equal(const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	r.v = _mm_cmple_ps(a.v, b.v);
+#else
+	const uint32_t ones = ~uint32_t(0), zero = 0;
+	for (int i = 0; i < 4; i++) std::memcpy(&r.e[i], a.e[i] <= b.e[i] ? &ones : &zero, sizeof(float));
+#endif
+	return r;
+}
+
+inline Float4 operator&(const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	r.v = _mm_and_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		uint32_t x, y;
+		std::memcpy(&x, &a.e[i], sizeof(float));
+		std::memcpy(&y, &b.e[i], sizeof(float));
+		x &= y;
+		std::memcpy(&r.e[i], &x, sizeof(float));
+	}
+#endif
+	return r;
+}
+
+inline Float4 select(const Float4& mask, const Float4& a, const Float4& b)
+{
+	// a where mask is set, b elsewhere
+	Float4 r;
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	r.v = _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		uint32_t m;
+		std::memcpy(&m, &mask.e[i], sizeof(float));
+		r.e[i] = m ? a.e[i] : b.e[i];
+	}
+#endif
+	return r;
+}
+
+inline int movemask(const Float4& mask)
+{
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	return _mm_movemask_ps(mask.v);
+#else
+	int bits = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uint32_t m;
+		std::memcpy(&m, &mask.e[i], sizeof(float));
+		bits |= (m != 0) << i;
+	}
+	return bits;
+#endif
+}
+
+inline int less_than(const Float4& a, const Float4& b)
+{
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; i++) mask |= (a.e[i] < b.e[i]) << i;
+	return mask;
+#endif
+}
+
+inline int less_equal(const Float4& a, const Float4& b)
+{
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE2)
+	return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; i++) mask |= (a.e[i] <= b.e[i]) << i;
+	return mask;
+#endif
+}
+
+// four lanes of Real, the kernels are written against this so they follow RT_SINGLE_PRECISION
+#ifdef RT_SINGLE_PRECISION
+typedef Float4 Real4;
+#else
+typedef Double4 Real4;
+#endif
+
+template<typename T>
+struct AlignedAllocator
+{
+	// std::allocator only honours alignas beyond 16 bytes from C++17 on, vectors of SIMD node types use this instead
+	typedef T value_type;
+
+	static const size_t ALIGNMENT = alignof(T) > 16 ? alignof(T) : 16;
+
+	AlignedAllocator() {}
+	template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		// over-allocates and keeps the pointer malloc returned just below the aligned block
+		void* raw = std::malloc(n * sizeof(T) + ALIGNMENT + sizeof(void*));
+		if (!raw)
+			throw std::bad_alloc();
+
+		uintptr_t aligned = (uintptr_t(raw) + sizeof(void*) + ALIGNMENT - 1) & ~uintptr_t(ALIGNMENT - 1);
+		reinterpret_cast<void**>(aligned)[-1] = raw;
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		std::free(reinterpret_cast<void**>(p)[-1]);
+	}
+
+	template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+#endif
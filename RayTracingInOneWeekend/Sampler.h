@@ -0,0 +1,393 @@
+#pragma once
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+// where the numbers of a camera sample come from:
+// Independent draws every number from the pixel sample's PCG32 stream,
+// Stratified jitters samples inside a shuffled grid of samples_per_pixel cells,
+// Sobol takes an Owen scrambled and shuffled Sobol sequence, scrambled anew for every pixel,
+// BlueNoise deals one scrambled Sobol sequence out over the whole image so that neighbouring pixels complement each
+// other, the error left in the image is then blue noise, fine grain that blurs away rather than blotches
+enum class SamplerType
+{
+	Independent,
+	Stratified,
+	Sobol,
+	BlueNoise
+};
+
+inline const char* sampler_name(SamplerType type)
+{
+	switch (type)
+	{
+	case SamplerType::Stratified:
+		return "stratified";
+	case SamplerType::Sobol:
+		return "sobol";
+	case SamplerType::BlueNoise:
+		return "bluenoise";
+	default:
+		return "independent";
+	}
+}
+
+inline bool parse_sampler(const std::string& name, SamplerType& type)
+{
+	for (SamplerType t : { SamplerType::Independent, SamplerType::Stratified, SamplerType::Sobol, SamplerType::BlueNoise })
+	{
+		if (name == sampler_name(t))
+		{
+			type = t;
+			return true;
+		}
+	}
+	return false;
+}
+
+// every sample is a point in a space of dimensions with fixed meanings, so that each dimension sees a well
+// distributed set of values over a pixel's samples: 0 and 1 place the sample in the pixel, 2 and 3 on the lens, and
+// bounce k owns six more, two for its scatter direction, one for its roulette draw and three for the light its
+// next-event estimation picks and the direction towards it
+const int FIRST_BOUNCE_DIMENSION = 4;
+const int BOUNCE_DIMENSIONS = 6;
+
+struct Sample2D
+{
+	double u, v;
+};
+
+struct SamplerState
+{
+	// what a path needs to draw its next number, copied along with its PCG32 state wherever paths are interleaved
+	SamplerType type = SamplerType::Independent;
+	int samples_per_pixel = 1;
+	int samples_log2 = 0;		// of the power of two covering samples_per_pixel
+	uint64_t pixel_seed = 0;
+	uint32_t sample = 0;
+	int dimension = 0;
+	uint64_t image_place = 0;	// BlueNoise only, the sample's place in the sequence of the whole image
+	int place_bits = 0;
+};
+
+inline SamplerState& thread_sampler()
+{
+	thread_local SamplerState state;
+	return state;
+}
+
+inline uint64_t spread_bits(uint32_t x)
+{
+	// the low 16 bits of x moved to the even bits of the result, half of a Morton code
+	uint64_t v = x & 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ffu;
+	v = (v | (v << 4)) & 0x0f0f0f0fu;
+	v = (v | (v << 2)) & 0x33333333u;
+	return (v | (v << 1)) & 0x55555555u;
+}
+
+inline void start_sample(SamplerType type, int i, int j, int image_width, int image_height, int sample, int samples_per_pixel)
+{
+	// starts the calling thread on sample of pixel i, j
+	const uint64_t index = uint64_t(j) * image_width + i;
+	seed_random(index, sample);
+	SamplerState& state = thread_sampler();
+	state.type = type;
+	state.samples_per_pixel = std::max(samples_per_pixel, 1);
+	state.samples_log2 = 0;
+	while ((1 << state.samples_log2) < state.samples_per_pixel)
+		state.samples_log2++;
+	state.pixel_seed = mix_bits(index);
+	state.sample = uint32_t(sample);
+	state.dimension = 0;
+
+	if (type == SamplerType::BlueNoise)
+	{
+		// pixels in Morton order over the smallest square power of two holding the image, each followed by its samples
+		int size_log2 = 0;
+		while ((1 << size_log2) < std::max(image_width, image_height))
+			size_log2++;
+		state.image_place = ((spread_bits(uint32_t(i)) | (spread_bits(uint32_t(j)) << 1)) << state.samples_log2) | uint32_t(sample);
+		state.place_bits = 2 * size_log2 + state.samples_log2;
+	}
+}
+
+inline void start_bounce(int bounce)
+{
+	thread_sampler().dimension = FIRST_BOUNCE_DIMENSION + BOUNCE_DIMENSIONS * bounce;
+}
+
+inline double unit_from_bits(uint32_t x) { return x * (1.0 / 4294967296.0); }
+
+inline uint32_t hash_seed(uint64_t a, uint64_t b) { return uint32_t(mix_bits(a ^ (b * 0x9e3779b97f4a7c15ULL))); }
+
+inline uint32_t mix_bits32(uint32_t v)
+{
+	// Wellons' lowbias32, a cheaper finaliser for the many small hashes of a single sample
+	v ^= v >> 16;
+	v *= 0x7feb352du;
+	v ^= v >> 15;
+	v *= 0x846ca68bu;
+	return v ^ (v >> 16);
+}
+
+inline uint32_t reverse_bits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+{
+	// Owen scrambling by hashing (Burley, Practical Hash-based Owen Scrambling, 2020): the Laine-Karras
+	// permutation only lets each bit depend on the bits below it, on reversed bits that is exactly an Owen scramble
+	x = reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverse_bits(x);
+}
+
+struct SobolTables
+{
+	// the second Sobol dimension's generator matrix, Pascal's triangle mod 2, applied a byte of the index at a time
+	uint32_t bytes[4][256];
+
+	SobolTables()
+	{
+		uint32_t columns[32];
+		columns[0] = 1u << 31;
+		for (int bit = 1; bit < 32; bit++)
+			columns[bit] = columns[bit - 1] ^ (columns[bit - 1] >> 1);
+
+		for (int byte = 0; byte < 4; byte++)
+		{
+			for (int value = 0; value < 256; value++)
+			{
+				uint32_t result = 0;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					if (value & (1 << bit))
+						result ^= columns[8 * byte + bit];
+				}
+				bytes[byte][value] = result;
+			}
+		}
+	}
+};
+
+inline uint32_t sobol_dimension1(uint32_t index)
+{
+	static const SobolTables tables;
+	return tables.bytes[0][index & 0xff] ^ tables.bytes[1][(index >> 8) & 0xff]
+		^ tables.bytes[2][(index >> 16) & 0xff] ^ tables.bytes[3][index >> 24];
+}
+
+inline Sample2D sobol_2d(uint32_t index, uint32_t seed)
+{
+	// a (0, 2)-sequence in base 2, Owen scrambled with seed; pairs of dimensions padded together this way avoid the
+	// poor projections of high dimensional Sobol sequences
+	uint32_t x = reverse_bits(index), y = sobol_dimension1(index);
+	x = nested_uniform_scramble(x, mix_bits32(seed + 1));
+	y = nested_uniform_scramble(y, mix_bits32(seed + 2));
+	return { unit_from_bits(x), unit_from_bits(y) };
+}
+
+inline double sobol_1d(uint32_t index, uint32_t seed)
+{
+	// scrambled van der Corput sequence
+	return unit_from_bits(nested_uniform_scramble(reverse_bits(index), mix_bits32(seed + 1)));
+}
+
+inline uint32_t permute_index(uint32_t i, uint32_t l, uint32_t p)
+{
+	// element i of a pseudo-random permutation of [0, l) chosen by p (Kensler, Correlated Multi-Jittered Sampling),
+	// hashes within the next power of two and walks the cycle until it lands below l
+	uint32_t w = l - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do
+	{
+		i ^= p;
+		i *= 0xe170893du;
+		i ^= p >> 16;
+		i ^= (i & w) >> 4;
+		i ^= p >> 8;
+		i *= 0x0929eb3fu;
+		i ^= p >> 23;
+		i ^= (i & w) >> 1;
+		i *= 1 | p >> 27;
+		i *= 0x6935fa69u;
+		i ^= (i & w) >> 11;
+		i *= 0x74dcb303u;
+		i ^= (i & w) >> 2;
+		i *= 0x9e501cc3u;
+		i ^= (i & w) >> 2;
+		i *= 0xc860a3dfu;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= l);
+	return (i + p) % l;
+}
+
+inline uint64_t blue_noise_index(const SamplerState& state, int dimension)
+{
+	// the base 4 digits of the sample's place in the image's sequence are shuffled by hashes of the digits above them,
+	// per dimension: the places of neighbouring pixels then share their upper digits, and the Sobol points at those
+	// places complement each other (Ahmed and Wonka 2020, as in pbrt-v4's ZSobolSampler)
+	static const uint8_t PERMUTATIONS[24][4] = {
+		{ 0, 1, 2, 3 }, { 0, 1, 3, 2 }, { 0, 2, 1, 3 }, { 0, 2, 3, 1 }, { 0, 3, 2, 1 }, { 0, 3, 1, 2 },
+		{ 1, 0, 2, 3 }, { 1, 0, 3, 2 }, { 1, 2, 0, 3 }, { 1, 2, 3, 0 }, { 1, 3, 2, 0 }, { 1, 3, 0, 2 },
+		{ 2, 1, 0, 3 }, { 2, 1, 3, 0 }, { 2, 0, 1, 3 }, { 2, 0, 3, 1 }, { 2, 3, 0, 1 }, { 2, 3, 1, 0 },
+		{ 3, 1, 2, 0 }, { 3, 1, 0, 2 }, { 3, 2, 1, 0 }, { 3, 2, 0, 1 }, { 3, 0, 2, 1 }, { 3, 0, 1, 2 }
+	};
+
+	const uint64_t place = state.image_place;
+
+	// an odd samples_log2 leaves one base 2 digit at the bottom, flipped by a hash of its own
+	const bool odd = (state.samples_log2 & 1) != 0;
+	const uint32_t dimension_key = 0x55555555u * uint32_t(dimension);
+	auto digit_hash = [dimension_key](uint64_t higher)
+	{
+		return mix_bits32(uint32_t(higher) ^ (uint32_t(higher >> 32) * 0x9e3779b9u) ^ dimension_key);
+	};
+	uint64_t index = 0;
+	for (int digit = (state.place_bits + 1) / 2 - 1; digit >= (odd ? 1 : 0); digit--)
+	{
+		const int shift = 2 * digit - (odd ? 1 : 0);
+		const uint32_t permutation = ((digit_hash(place >> (shift + 2)) >> 8) * 24) >> 24;
+		index |= uint64_t(PERMUTATIONS[permutation][(place >> shift) & 3]) << shift;
+	}
+	if (odd)
+		index |= (place & 1) ^ (digit_hash(place >> 1) & 1);
+	return index;
+}
+
+inline uint32_t blue_noise_seed(uint64_t index, int dimension)
+{
+	// the sequence only has 2^32 points, every block of them in a larger image is scrambled on its own
+	return hash_seed(index >> 32, uint64_t(dimension));
+}
+
+inline double sobol_sample_1d(const SamplerState& state, int dimension)
+{
+	// the index is shuffled too, or every dimension would walk the sequence in the same order
+	uint32_t seed = hash_seed(state.pixel_seed, uint64_t(dimension));
+	return sobol_1d(nested_uniform_scramble(state.sample, seed), seed);
+}
+
+inline Sample2D sobol_sample_2d(const SamplerState& state, int dimension)
+{
+	uint32_t seed = hash_seed(state.pixel_seed, uint64_t(dimension));
+	return sobol_2d(nested_uniform_scramble(state.sample, seed), seed);
+}
+
+inline double sample_1d()
+{
+	// the next dimension of the calling thread's sample, in [0, 1)
+	SamplerState& state = thread_sampler();
+	const int dimension = state.dimension++;
+
+	switch (state.type)
+	{
+	case SamplerType::Stratified:
+	{
+		const uint32_t n = uint32_t(state.samples_per_pixel);
+		if (state.sample >= n)
+			return random_double();
+		uint32_t stratum = permute_index(state.sample, n, hash_seed(state.pixel_seed, uint64_t(dimension)));
+		return (stratum + random_double()) / n;
+	}
+	case SamplerType::Sobol:
+		return sobol_sample_1d(state, dimension);
+	case SamplerType::BlueNoise:
+	{
+		// samples past the power of two the image's sequence was laid out for, e.g. added on resume, are plain Sobol ones
+		if (state.sample >> state.samples_log2 != 0)
+			return sobol_sample_1d(state, dimension);
+		uint64_t index = blue_noise_index(state, dimension);
+		return sobol_1d(uint32_t(index), blue_noise_seed(index, dimension));
+	}
+	default:
+		return random_double();
+	}
+}
+
+inline Sample2D sample_2d()
+{
+	// the next two dimensions of the calling thread's sample, stratified jointly
+	SamplerState& state = thread_sampler();
+	const int dimension = state.dimension;
+	state.dimension += 2;
+
+	switch (state.type)
+	{
+	case SamplerType::Stratified:
+	{
+		// the largest grid of at most samples_per_pixel cells, samples beyond it fall back to independent ones
+		const int nx = std::max(1, int(std::sqrt(double(state.samples_per_pixel))));
+		const int ny = state.samples_per_pixel / nx;
+		const uint32_t cells = uint32_t(nx * ny);
+		if (state.sample >= cells)
+			break;
+		uint32_t cell = permute_index(state.sample, cells, hash_seed(state.pixel_seed, uint64_t(dimension)));
+		double u = random_double(), v = random_double();
+		return { (cell % nx + u) / nx, (cell / nx + v) / ny };
+	}
+	case SamplerType::Sobol:
+		return sobol_sample_2d(state, dimension);
+	case SamplerType::BlueNoise:
+	{
+		if (state.sample >> state.samples_log2 != 0)
+			return sobol_sample_2d(state, dimension);
+		uint64_t index = blue_noise_index(state, dimension);
+		return sobol_2d(uint32_t(index), blue_noise_seed(index, dimension));
+	}
+	default:
+		break;
+	}
+	double u = random_double();
+	return { u, random_double() };
+}
+
+inline double roulette_sample(int bounce)
+{
+	// the roulette draw of a bounce has a dimension of its own, whatever its scatter direction took
+	thread_sampler().dimension = FIRST_BOUNCE_DIMENSION + BOUNCE_DIMENSIONS * bounce + 2;
+	return sample_1d();
+}
+
+inline Sample2D light_sample(int bounce, double& select)
+{
+	// which light next-event estimation aims at, and where on it
+	thread_sampler().dimension = FIRST_BOUNCE_DIMENSION + BOUNCE_DIMENSIONS * bounce + 3;
+	select = sample_1d();
+	return sample_2d();
+}
+
+inline Vec3 sample_unit_vector()
+{
+	Sample2D s = sample_2d();
+	return unit_vector_from_square(s.u, s.v);
+}
+
+inline Vec3 sample_unit_disk()
+{
+	Sample2D s = sample_2d();
+	return unit_disk_from_square(s.u, s.v);
+}
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef SCENE_BUILDER_H
+#define SCENE_BUILDER_H
+
+#include "Arena.h"
+#include "FlatBVH.h"
+#include "MaterialTable.h"
+#include "SphereSet.h"
+
+#include <utility>
+#include <vector>
+
+class PackedScene
+{
+public:
+	// a finished scene: every sphere packed into the leaves of one FlatBVH, the materials in one table and all other
+	// objects in the arena they were built in, the BVH points at them without reference counts, and nothing changes
+	// until the scene is destroyed
+	PackedScene(PackedScene&&) = default;
+
+	const Hittable& world() const { return bvh; }
+	const MaterialTable& materials() const { return material_table; }
+
+	size_t arena_bytes() const { return arena.bytes_reserved(); }
+
+private:
+	friend class SceneBuilder;
+
+	Arena arena;		// declared first, so it outlives the BVH pointing into it
+	MaterialTable material_table;
+	FlatBVH bvh;
+
+	PackedScene(Arena&& arena, MaterialTable&& materials, const SphereSet& spheres, const std::vector<const Hittable*>& objects)
+		: arena(std::move(arena)), material_table(std::move(materials)), bvh(spheres, objects) {}
+};
+
+class SceneBuilder
+{
+public:
+	// collects a scene without a heap allocation per object: spheres go straight into packed arrays, materials into
+	// the table and every other object is constructed in a monotonic arena, build then packs it all into a PackedScene
+
+	int add_material(const Material& mat) { return materials.add(mat); }
+
+	void add_sphere(const Point3& center, Real radius, int material_id) { spheres.add(center, radius, material_id); }
+
+	void reserve_spheres(size_t count) { spheres.reserve(count); }
+
+	template<typename T, typename... Args>
+	T& make(Args&&... args)
+	{
+		// constructs an object in the arena without adding it to the world, e.g. a cluster that instances share
+		return *arena.create<T>(std::forward<Args>(args)...);
+	}
+
+	template<typename T, typename... Args>
+	T& add(Args&&... args)
+	{
+		T& object = make<T>(std::forward<Args>(args)...);
+		objects.push_back(&object);
+		return object;
+	}
+
+	int sphere_count() const { return spheres.size(); }
+	int object_count() const { return int(objects.size()); }
+
+	PackedScene build()
+	{
+		// hands everything over to the scene, the builder is left empty
+		PackedScene scene(std::move(arena), std::move(materials), spheres, objects);
+		materials = MaterialTable();
+		spheres = SphereSet();
+		objects.clear();
+		return scene;
+	}
+
+private:
+	Arena arena;
+	MaterialTable materials;
+	SphereSet spheres;
+	std::vector<const Hittable*> objects;
+};
+
+#endif
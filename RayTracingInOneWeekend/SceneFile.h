@@ -0,0 +1,530 @@
+#pragma once
+
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "Camera.h"
+#include "MappedFile.h"
+#include "MaterialTable.h"
+#include "SphereSet.h"
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// scenes are stored either as text for authoring or as a binary image of the sphere arrays for fast loading,
+// load_scene tells the two apart by the binary magic and save_scene picks the format from the extension
+//
+// the text format has one statement per line, # starts a comment, and materials are named before spheres use them:
+//   image_width 1920
+//   lookfrom 13 2 3
+//   lambertian ground 0.5 0.5 0.5
+//   metal mirror 0.7 0.6 0.5 0.0
+//   dielectric glass 1.5
+//   diffuse_light lamp 4 4 4
+//   sphere 0 -1000 0 1000 ground
+
+struct SceneCamera
+{
+	// the Camera settings a scene file can carry, defaults are the Camera's own
+	double aspect_ratio = 1.0;
+	int image_width = 100;
+	int samples_per_pixel = 10;
+	int max_depth = 10;
+
+	double vfov = 90.0;
+	Point3 lookfrom = Point3(0, 0, 0);
+	Point3 lookat = Point3(0, 0, -1);
+	Vec3 vup = Vec3(0, 1, 0);
+
+	double defocus_angle = 0.0;
+	double focus_dist = 10.0;
+
+	void apply(Camera& camera) const
+	{
+		camera.aspect_ratio = aspect_ratio;
+		camera.image_width = image_width;
+		camera.samples_per_pixel = samples_per_pixel;
+		camera.max_depth = max_depth;
+		camera.vfov = vfov;
+		camera.lookfrom = lookfrom;
+		camera.lookat = lookat;
+		camera.vup = vup;
+		camera.defocus_angle = defocus_angle;
+		camera.focus_dist = focus_dist;
+	}
+};
+
+struct Scene
+{
+	SceneCamera camera;
+	MaterialTable materials;
+	SphereSet spheres;		// unpadded, FlatBVH(spheres) builds the acceleration structure straight from the arrays
+};
+
+// binary layout, little endian: the header, material_count BinaryMaterials, then the spheres as five arrays of
+// sphere_count entries each (center x, y, z and radius as doubles, material ids as int32), every section 8 byte aligned
+struct BinarySceneHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t material_count;
+	uint64_t sphere_count;
+	double camera[16];
+};
+
+struct BinaryMaterial
+{
+	uint32_t type;
+	uint32_t reserved;
+	double albedo[3];
+	double fuzz;
+	double refraction_index;
+};
+
+static_assert(sizeof(BinarySceneHeader) == 152, "binary scene header must match the file layout");
+static_assert(sizeof(BinaryMaterial) == 48, "binary material must match the file layout");
+
+static const char BINARY_SCENE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+static const uint32_t BINARY_SCENE_VERSION = 1;
+static const size_t BINARY_SPHERE_SIZE = 4 * sizeof(double) + sizeof(int32_t);
+
+inline void camera_to_array(const SceneCamera& camera, double* values)
+{
+	const double fields[16] = {
+		camera.aspect_ratio, double(camera.image_width), double(camera.samples_per_pixel), double(camera.max_depth),
+		camera.vfov,
+		camera.lookfrom.x(), camera.lookfrom.y(), camera.lookfrom.z(),
+		camera.lookat.x(), camera.lookat.y(), camera.lookat.z(),
+		camera.vup.x(), camera.vup.y(), camera.vup.z(),
+		camera.defocus_angle, camera.focus_dist
+	};
+	std::memcpy(values, fields, sizeof(fields));
+}
+
+inline void camera_from_array(const double* values, SceneCamera& camera)
+{
+	camera.aspect_ratio = values[0];
+	camera.image_width = int(values[1]);
+	camera.samples_per_pixel = int(values[2]);
+	camera.max_depth = int(values[3]);
+	camera.vfov = values[4];
+	camera.lookfrom = Point3(values[5], values[6], values[7]);
+	camera.lookat = Point3(values[8], values[9], values[10]);
+	camera.vup = Vec3(values[11], values[12], values[13]);
+	camera.defocus_angle = values[14];
+	camera.focus_dist = values[15];
+}
+
+inline bool parse_scene_binary(const unsigned char* data, size_t size, Scene& scene, std::string& error)
+{
+	// data must be 8 byte aligned, as a mapped file is, the sphere arrays are read in place without copying per sphere
+	BinarySceneHeader header;
+	if (size < sizeof(header))
+	{
+		error = "truncated header";
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.magic, BINARY_SCENE_MAGIC, sizeof(header.magic)) != 0)
+	{
+		error = "not a binary scene";
+		return false;
+	}
+	if (header.version != BINARY_SCENE_VERSION)
+	{
+		error = "unsupported version " + std::to_string(header.version);
+		return false;
+	}
+	if (!host_is_little_endian())
+	{
+		error = "binary scenes can only be read on little endian hosts";
+		return false;
+	}
+	if (header.sphere_count > uint64_t(INT_MAX) || header.material_count > uint32_t(INT_MAX))
+	{
+		error = "too many spheres or materials";
+		return false;
+	}
+
+	const size_t material_count = header.material_count;
+	const size_t sphere_count = size_t(header.sphere_count);
+	const size_t materials_offset = sizeof(header);
+	const size_t spheres_offset = materials_offset + material_count * sizeof(BinaryMaterial);
+	if (size < spheres_offset + sphere_count * BINARY_SPHERE_SIZE)
+	{
+		error = "truncated data";
+		return false;
+	}
+
+	scene = Scene();
+	camera_from_array(header.camera, scene.camera);
+
+	for (size_t m = 0; m < material_count; m++)
+	{
+		BinaryMaterial mat;
+		std::memcpy(&mat, data + materials_offset + m * sizeof(BinaryMaterial), sizeof(mat));
+
+		Color albedo(mat.albedo[0], mat.albedo[1], mat.albedo[2]);
+		switch (MaterialType(mat.type))
+		{
+		case MaterialType::Lambertian:
+			scene.materials.add(Lambertian(albedo));
+			break;
+		case MaterialType::Metal:
+			scene.materials.add(Metal(albedo, Real(mat.fuzz)));
+			break;
+		case MaterialType::Dielectric:
+			scene.materials.add(Dielectric(Real(mat.refraction_index)));
+			break;
+		case MaterialType::DiffuseLight:
+			scene.materials.add(DiffuseLight(albedo));
+			break;
+		default:
+			error = "unknown material type " + std::to_string(mat.type);
+			return false;
+		}
+	}
+
+	const double* x = (const double*)(data + spheres_offset);
+	const double* y = x + sphere_count;
+	const double* z = y + sphere_count;
+	const double* radius = z + sphere_count;
+	const int32_t* material_id = (const int32_t*)(radius + sphere_count);
+	for (size_t s = 0; s < sphere_count; s++)
+	{
+		if (material_id[s] < 0 || material_id[s] >= int32_t(material_count))
+		{
+			error = "sphere " + std::to_string(s) + " has no valid material";
+			return false;
+		}
+	}
+
+	scene.spheres.assign(sphere_count, x, y, z, radius, material_id);
+	return true;
+}
+
+class SceneTextParser
+{
+public:
+	// text is null terminated, numbers are read with strtod straight out of it
+	SceneTextParser(const char* text) : p(text) {}
+
+	bool parse(Scene& scene, std::string& error)
+	{
+		scene = Scene();
+		std::unordered_map<std::string, int> material_ids;
+
+		while (*p)
+		{
+			if (at_line_end())
+			{
+				next_line();
+				continue;
+			}
+
+			std::string keyword = word();
+			SceneCamera& cam = scene.camera;
+			bool ok = true;
+
+			if (keyword == "sphere")
+			{
+				Point3 center;
+				double radius;
+				ok = point(center) && number(radius);
+				if (ok)
+				{
+					std::string name = word();
+					auto found = material_ids.find(name);
+					if (found == material_ids.end())
+						return fail(error, "unknown material '" + name + "'");
+					scene.spheres.add(center, Real(radius), found->second);
+				}
+			}
+			else if (keyword == "lambertian" || keyword == "metal" || keyword == "dielectric" || keyword == "diffuse_light")
+			{
+				std::string name = word();
+				Color albedo;
+				double value = 0;
+				if (keyword == "lambertian" || keyword == "diffuse_light")
+					ok = point(albedo);
+				else if (keyword == "metal")
+					ok = point(albedo) && number(value);
+				else
+					ok = number(value);
+
+				if (ok && !name.empty())
+				{
+					if (keyword == "lambertian")
+						material_ids[name] = scene.materials.add(Lambertian(albedo));
+					else if (keyword == "metal")
+						material_ids[name] = scene.materials.add(Metal(albedo, Real(value)));
+					else if (keyword == "diffuse_light")
+						material_ids[name] = scene.materials.add(DiffuseLight(albedo));
+					else
+						material_ids[name] = scene.materials.add(Dielectric(Real(value)));
+				}
+				ok = ok && !name.empty();
+			}
+			else if (keyword == "aspect_ratio") ok = number(cam.aspect_ratio);
+			else if (keyword == "image_width") ok = integer(cam.image_width);
+			else if (keyword == "samples_per_pixel") ok = integer(cam.samples_per_pixel);
+			else if (keyword == "max_depth") ok = integer(cam.max_depth);
+			else if (keyword == "vfov") ok = number(cam.vfov);
+			else if (keyword == "lookfrom") ok = point(cam.lookfrom);
+			else if (keyword == "lookat") ok = point(cam.lookat);
+			else if (keyword == "vup") ok = point(cam.vup);
+			else if (keyword == "defocus_angle") ok = number(cam.defocus_angle);
+			else if (keyword == "focus_dist") ok = number(cam.focus_dist);
+			else
+				return fail(error, "unknown statement '" + keyword + "'");
+
+			if (!ok || !at_line_end())
+				return fail(error, "malformed " + keyword);
+			next_line();
+		}
+		return true;
+	}
+
+private:
+	const char* p;
+	int line = 1;
+
+	bool fail(std::string& error, const std::string& message) const
+	{
+		error = "line " + std::to_string(line) + ": " + message;
+		return false;
+	}
+
+	void skip_blanks()
+	{
+		while (*p == ' ' || *p == '\t' || *p == '\r')
+			p++;
+	}
+
+	bool at_line_end()
+	{
+		skip_blanks();
+		return *p == '\n' || *p == '#' || *p == 0;
+	}
+
+	void next_line()
+	{
+		while (*p && *p != '\n')
+			p++;
+		if (*p)
+		{
+			p++;
+			line++;
+		}
+	}
+
+	std::string word()
+	{
+		skip_blanks();
+		const char* start = p;
+		while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+			p++;
+		return std::string(start, p);
+	}
+
+	bool number(double& value)
+	{
+		skip_blanks();
+		char* end;
+		value = std::strtod(p, &end);
+		if (end == p)
+			return false;
+		p = end;
+		return true;
+	}
+
+	bool integer(int& value)
+	{
+		double v;
+		if (!number(v) || v != std::floor(v) || v < INT_MIN || v > INT_MAX)
+			return false;
+		value = int(v);
+		return true;
+	}
+
+	bool point(Vec3& value)
+	{
+		double x, y, z;
+		if (!number(x) || !number(y) || !number(z))
+			return false;
+		value = Vec3(x, y, z);
+		return true;
+	}
+};
+
+inline bool load_scene(const std::string& path, Scene& scene)
+{
+	MappedFile file;
+	std::string error;
+	bool loaded = false;
+
+	if (!file.open(path))
+	{
+		error = "cannot open file";
+	}
+	else if (file.size() >= sizeof(BINARY_SCENE_MAGIC)
+		&& std::memcmp(file.data(), BINARY_SCENE_MAGIC, sizeof(BINARY_SCENE_MAGIC)) == 0)
+	{
+		loaded = parse_scene_binary(file.data(), file.size(), scene, error);
+	}
+	else
+	{
+		// the parser needs a terminating null, which a mapping doesn't have
+		std::string text((const char*)file.data(), file.size());
+		loaded = SceneTextParser(text.c_str()).parse(scene, error);
+	}
+
+	if (!loaded)
+		std::clog << "Failed to load " << path << ": " << error << "\n";
+	return loaded;
+}
+
+inline void write_scene_text(const Scene& scene, std::ostream& out)
+{
+	// materials are named m<index>, numbers carry enough digits to read back exactly
+	const SceneCamera& cam = scene.camera;
+	out << std::setprecision(std::numeric_limits<double>::max_digits10);
+	out << "aspect_ratio " << cam.aspect_ratio << "\n";
+	out << "image_width " << cam.image_width << "\n";
+	out << "samples_per_pixel " << cam.samples_per_pixel << "\n";
+	out << "max_depth " << cam.max_depth << "\n";
+	out << "vfov " << cam.vfov << "\n";
+	out << "lookfrom " << cam.lookfrom << "\n";
+	out << "lookat " << cam.lookat << "\n";
+	out << "vup " << cam.vup << "\n";
+	out << "defocus_angle " << cam.defocus_angle << "\n";
+	out << "focus_dist " << cam.focus_dist << "\n\n";
+
+	for (int m = 0; m < scene.materials.size(); m++)
+	{
+		const Material& mat = scene.materials[m];
+		switch (mat.type())
+		{
+		case MaterialType::Lambertian:
+			out << "lambertian m" << m << " " << mat.color() << "\n";
+			break;
+		case MaterialType::Metal:
+			out << "metal m" << m << " " << mat.color() << " " << mat.fuzziness() << "\n";
+			break;
+		case MaterialType::DiffuseLight:
+			out << "diffuse_light m" << m << " " << mat.color() << "\n";
+			break;
+		default:
+			out << "dielectric m" << m << " " << mat.ior() << "\n";
+			break;
+		}
+	}
+	out << "\n";
+
+	for (int s = 0; s < scene.spheres.size(); s++)
+	{
+		if (!scene.spheres.is_padding(s))
+			out << "sphere " << scene.spheres.center(s) << " " << scene.spheres.radius(s) << " m" << scene.spheres.material_id(s) << "\n";
+	}
+}
+
+inline void write_scene_binary(const Scene& scene, std::ostream& out)
+{
+	std::vector<double> x, y, z, radius;
+	std::vector<int32_t> material_id;
+	for (int s = 0; s < scene.spheres.size(); s++)
+	{
+		if (scene.spheres.is_padding(s))
+			continue;
+
+		Point3 center = scene.spheres.center(s);
+		x.push_back(center.x());
+		y.push_back(center.y());
+		z.push_back(center.z());
+		radius.push_back(scene.spheres.radius(s));
+		material_id.push_back(scene.spheres.material_id(s));
+	}
+
+	BinarySceneHeader header = {};
+	std::memcpy(header.magic, BINARY_SCENE_MAGIC, sizeof(header.magic));
+	header.version = BINARY_SCENE_VERSION;
+	header.material_count = uint32_t(scene.materials.size());
+	header.sphere_count = x.size();
+	camera_to_array(scene.camera, header.camera);
+	out.write((const char*)&header, sizeof(header));
+
+	for (int m = 0; m < scene.materials.size(); m++)
+	{
+		const Material& mat = scene.materials[m];
+		BinaryMaterial record = {};
+		record.type = uint32_t(mat.type());
+		record.albedo[0] = mat.color().x();
+		record.albedo[1] = mat.color().y();
+		record.albedo[2] = mat.color().z();
+		record.fuzz = mat.fuzziness();
+		record.refraction_index = mat.ior();
+		out.write((const char*)&record, sizeof(record));
+	}
+
+	out.write((const char*)x.data(), x.size() * sizeof(double));
+	out.write((const char*)y.data(), y.size() * sizeof(double));
+	out.write((const char*)z.data(), z.size() * sizeof(double));
+	out.write((const char*)radius.data(), radius.size() * sizeof(double));
+	out.write((const char*)material_id.data(), material_id.size() * sizeof(int32_t));
+}
+
+inline uint32_t scene_content_hash(const Scene& scene)
+{
+	// FNV-1a over the materials and spheres, the camera is hashed by Camera::settings_hash
+	uint32_t hash = fnv1a(nullptr, 0);
+	for (int id = 0; id < scene.materials.size(); id++)
+	{
+		const Material& mat = scene.materials[id];
+		const double values[] = { double(mat.type()), double(mat.color().x()), double(mat.color().y()),
+			double(mat.color().z()), double(mat.fuzziness()), double(mat.ior()) };
+		hash = fnv1a(values, sizeof(values), hash);
+	}
+	for (int i = 0; i < scene.spheres.size(); i++)
+	{
+		if (scene.spheres.is_padding(i))
+			continue;
+		const Point3 center = scene.spheres.center(i);
+		const double values[] = { double(center.x()), double(center.y()), double(center.z()),
+			double(scene.spheres.radius(i)), double(scene.spheres.material_id(i)) };
+		hash = fnv1a(values, sizeof(values), hash);
+	}
+	return hash;
+}
+
+inline bool is_binary_scene_path(const std::string& path)
+{
+	const std::string ext = ".bscene";
+	return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+inline bool save_scene(const Scene& scene, const std::string& path)
+{
+	// .bscene files are written in the binary format, anything else as text
+	bool binary = is_binary_scene_path(path);
+	if (binary && !host_is_little_endian())
+		return false;
+
+	std::ofstream file(path, binary ? std::ios::binary : std::ios::out);
+	if (!file)
+		return false;
+
+	if (binary)
+		write_scene_binary(scene, file);
+	else
+		write_scene_text(scene, file);
+	return bool(file);
+}
+
+#endif
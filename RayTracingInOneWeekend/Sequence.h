@@ -0,0 +1,138 @@
+#pragma once
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "Camera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct CameraKeyframe
+{
+	double time;
+	Point3 lookfrom;
+	Point3 lookat;
+	double vfov;
+	double focus_dist;
+};
+
+template<typename T>
+T catmull_rom(const T& p0, const T& p1, const T& p2, const T& p3, double t)
+{
+	// uniform Catmull-Rom spline between p1 and p2, passes through every key with a continuous tangent
+	double t2 = t * t, t3 = t2 * t;
+	double w0 = 0.5 * (-t3 + 2 * t2 - t);
+	double w1 = 0.5 * (3 * t3 - 5 * t2 + 2);
+	double w2 = 0.5 * (-3 * t3 + 4 * t2 + t);
+	double w3 = 0.5 * (t3 - t2);
+	return w0 * p0 + w1 * p1 + w2 * p2 + w3 * p3;
+}
+
+class CameraPath
+{
+public:
+	// keyframed camera parameters, interpolated along a Catmull-Rom spline and held constant outside the keys
+	void add(const CameraKeyframe& key)
+	{
+		auto later = std::upper_bound(keys.begin(), keys.end(), key.time,
+			[](double time, const CameraKeyframe& k) { return time < k.time; });
+		keys.insert(later, key);
+	}
+
+	bool empty() const { return keys.empty(); }
+
+	CameraKeyframe at(double time) const
+	{
+		if (keys.size() == 1 || time <= keys.front().time)
+			return keys.front();
+		if (time >= keys.back().time)
+			return keys.back();
+
+		int k = int(std::upper_bound(keys.begin(), keys.end(), time,
+			[](double t, const CameraKeyframe& key) { return t < key.time; }) - keys.begin()) - 1;
+
+		// the end keys are repeated where the spline needs a neighbour that doesn't exist
+		const CameraKeyframe& k0 = keys[std::max(k - 1, 0)];
+		const CameraKeyframe& k1 = keys[k];
+		const CameraKeyframe& k2 = keys[k + 1];
+		const CameraKeyframe& k3 = keys[std::min(k + 2, int(keys.size()) - 1)];
+		double t = (time - k1.time) / (k2.time - k1.time);
+
+		CameraKeyframe result;
+		result.time = time;
+		result.lookfrom = catmull_rom(k0.lookfrom, k1.lookfrom, k2.lookfrom, k3.lookfrom, t);
+		result.lookat = catmull_rom(k0.lookat, k1.lookat, k2.lookat, k3.lookat, t);
+		result.vfov = catmull_rom(k0.vfov, k1.vfov, k2.vfov, k3.vfov, t);
+		result.focus_dist = catmull_rom(k0.focus_dist, k1.focus_dist, k2.focus_dist, k3.focus_dist, t);
+		return result;
+	}
+
+	void apply(double time, Camera& camera) const
+	{
+		CameraKeyframe key = at(time);
+		camera.lookfrom = key.lookfrom;
+		camera.lookat = key.lookat;
+		camera.vfov = key.vfov;
+		camera.focus_dist = key.focus_dist;
+	}
+
+private:
+	std::vector<CameraKeyframe> keys;		// sorted by time
+};
+
+class SequenceRenderer
+{
+public:
+	// renders a whole sequence in one process, reusing the scene, its BVH, the camera's framebuffer and the process
+	// per frame, animate moves the scene to the frame's time (and refits its BVH), the path places the camera and
+	// the image is written to output_pattern with the frame number filled in by printf
+	int frame_count = 1;
+	double start_time = 0.0;
+	double end_time = 1.0;
+	std::string output_pattern = "frame_%04d.png";
+	std::function<void(int frame, double time)> animate;
+
+	bool render(Camera& camera, const CameraPath& path) const
+	{
+		double setup_seconds = 0, render_seconds = 0, write_seconds = 0;
+		bool written = true;
+
+		for (int frame = 0; frame < frame_count; frame++)
+		{
+			double time = frame_count > 1 ? start_time + (end_time - start_time) * frame / (frame_count - 1) : start_time;
+			auto start = std::chrono::steady_clock::now();
+
+			if (animate)
+				animate(frame, time);
+			if (!path.empty())
+				path.apply(time, camera);
+
+			char name[1024];
+			std::snprintf(name, sizeof(name), output_pattern.c_str(), frame);
+			camera.output_path = name;
+
+			auto rendered = std::chrono::steady_clock::now();
+			if (camera.show_progress)
+				std::clog << "\rFrame " << frame + 1 << "/" << frame_count << "\n";
+			written = camera.render() && written;
+			auto finished = std::chrono::steady_clock::now();
+
+			// render() times its own path tracing, what else it spent went into writing the image
+			double frame_total = std::chrono::duration<double>(finished - rendered).count();
+			setup_seconds += std::chrono::duration<double>(rendered - start).count();
+			render_seconds += camera.render_time();
+			write_seconds += frame_total - camera.render_time();
+		}
+
+		std::clog << frame_count << " frames, per frame: " << 1e3 * setup_seconds / frame_count << " ms scene and camera update, "
+			<< render_seconds / frame_count << " s rendering, " << 1e3 * write_seconds / frame_count << " ms writing\n";
+		return written;
+	}
+};
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#ifndef SKY_H
+#define SKY_H
+
+#include "RTWeekend.h"
+
+inline Color sky_color(const Ray& r)
+{
+	// the background, lighting every ray that leaves the scene, a vertical gradient from white to light blue
+	Vec3 unit_dir = unit_vector(r.direction());
+	Real a = Real(0.5) * (unit_dir.y() + 1);
+	return (1 - a) * Color(1, 1, 1) + a * Color(Real(0.5), Real(0.7), 1);
+}
+
+#endif
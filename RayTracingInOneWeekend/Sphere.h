@@ -8,7 +8,7 @@
 class Sphere : public Hittable
 {
 public:
-	Sphere(const Point3& center, double radius, std::shared_ptr<Material> mat) : center(center), radius(fmax(0, radius)), mat(mat)
+	Sphere(const Point3& center, Real radius, int material_id) : cen(center), rad(std::fmax(Real(0), radius)), mat_id(material_id)
 	{
 		auto rvec = Vec3(radius, radius, radius);
 		bbox = AABB(center - rvec, center + rvec);
@@ -16,11 +16,13 @@ public:
 
 	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override
 	{
-		Vec3 oc = center - r.origin();
-		double a = r.direction().length_squared();
-		double h = dot(r.direction(), oc);
-		double c = oc.length_squared() - radius * radius;
-		double discriminant = h * h - a * c;
+		RT_STAT(sphere_tests++);
+
+		Vec3 oc = cen - r.origin();
+		Real a = r.direction().length_squared();
+		Real h = dot(r.direction(), oc);
+		Real c = oc.length_squared() - rad * rad;
+		Real discriminant = h * h - a * c;
 
 		if (discriminant < 0)
 			return false;
@@ -36,22 +38,87 @@ public:
 				return false;
 		}
 
-		rec.t = root;
-		rec.p = r.at(rec.t);
-		Vec3 outward_normal = (rec.p - center) / radius;
-		rec.set_face_normal(r, outward_normal);
-		rec.mat = mat;
-
+		set_hit_record(r, root, rec);
 		return true;
 	}
 
+	int hit_packet(const RayPacket& packet, int lane_mask, Real t_min, Real* t_max, HitRecord* recs) const override
+	{
+		// the same quadratic as hit(), solved for a group of lanes at once
+		RT_STAT(sphere_tests += RayPacket::lane_count(lane_mask));
+
+		int hit_mask = 0;
+		for (int g = 0; g < packet.groups(); g++)
+		{
+			const int lanes = RayPacket::group_mask(lane_mask, g);
+			if (lanes == 0)
+				continue;
+
+			const int first = RayPacket::GROUP * g;
+			const Real4 oc_x = Real4::broadcast(cen.x()) - Real4::load(packet.orig[0] + first);
+			const Real4 oc_y = Real4::broadcast(cen.y()) - Real4::load(packet.orig[1] + first);
+			const Real4 oc_z = Real4::broadcast(cen.z()) - Real4::load(packet.orig[2] + first);
+			const Real4 d_x = Real4::load(packet.dir[0] + first);
+			const Real4 d_y = Real4::load(packet.dir[1] + first);
+			const Real4 d_z = Real4::load(packet.dir[2] + first);
+
+			const Real4 a = d_x * d_x + d_y * d_y + d_z * d_z;
+			const Real4 h = d_x * oc_x + d_y * oc_y + d_z * oc_z;
+			const Real4 c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - Real4::broadcast(rad * rad);
+			const Real4 discriminant = h * h - a * c;
+
+			int candidates = less_equal(Real4::broadcast(0), discriminant) & lanes;
+			if (candidates == 0)
+				continue;
+
+			const Real4 sqrtd = sqrt(max(discriminant, Real4::broadcast(0)));
+			Real near_roots[RayPacket::GROUP], far_roots[RayPacket::GROUP];
+			((h - sqrtd) / a).store(near_roots);
+			((h + sqrtd) / a).store(far_roots);
+
+			for (int k = 0; k < RayPacket::GROUP; k++)
+			{
+				if (!(candidates & (1 << k)))
+					continue;
+
+				const int lane = first + k;
+				Interval ray_t(t_min, t_max[lane]);
+				Real root = near_roots[k];
+				if (!ray_t.surrrounds(root))
+				{
+					root = far_roots[k];
+					if (!ray_t.surrrounds(root))
+						continue;
+				}
+
+				set_hit_record(packet.rays[lane], root, recs[lane]);
+				t_max[lane] = root;
+				hit_mask |= 1 << lane;
+			}
+		}
+		return hit_mask;
+	}
+
 	AABB bounding_box() const override { return bbox; }
 
+	const Point3& center() const { return cen; }
+	Real radius() const { return rad; }
+	int material_id() const { return mat_id; }
+
 private:
-	Point3 center;
-	double radius;
-	std::shared_ptr<Material> mat;
+	Point3 cen;
+	Real rad;
+	int mat_id;
 	AABB bbox;
+
+	void set_hit_record(const Ray& r, Real root, HitRecord& rec) const
+	{
+		rec.t = root;
+		rec.p = r.at(rec.t);
+		Vec3 outward_normal = (rec.p - cen) / rad;
+		rec.set_face_normal(r, outward_normal);
+		rec.material_id = mat_id;
+	}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,324 @@
+#pragma once
+
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Sphere.h"
+#include "SIMD.h"
+
+#include <vector>
+
+class SphereSet : public Hittable
+{
+public:
+	// spheres tested per instruction, pad() rounds the arrays up to a multiple of this, add and assign leave them as they
+	// are and hit_range masks the tail of an unpadded set
+	static const int WIDTH = 4;
+
+	SphereSet() {}
+
+	SphereSet(const HittableList& list)
+	{
+		// packs every Sphere of the list, anything else is kept aside and tested one by one
+		for (const std::shared_ptr<Hittable>& object : list.objects)
+		{
+			if (const Sphere* sphere = dynamic_cast<const Sphere*>(object.get()))
+				add(*sphere);
+			else
+				others.add(object);
+		}
+		pad();
+	}
+
+	void add(const Sphere& sphere)
+	{
+		add(sphere.center(), sphere.radius(), sphere.material_id());
+	}
+
+	void add(const Point3& center, Real radius, int material_id)
+	{
+		center_x.push_back(center.x());
+		center_y.push_back(center.y());
+		center_z.push_back(center.z());
+		radii.push_back(radius);
+		radii_sq.push_back(radius * radius);
+		material_ids.push_back(material_id);
+
+		Vec3 rvec(radius, radius, radius);
+		bbox = AABB(bbox, AABB(center - rvec, center + rvec));
+	}
+
+	void reserve(size_t count)
+	{
+		center_x.reserve(count);
+		center_y.reserve(count);
+		center_z.reserve(count);
+		radii.reserve(count);
+		radii_sq.reserve(count);
+		material_ids.reserve(count);
+	}
+
+	void assign(size_t count, const double* x, const double* y, const double* z, const double* radius,
+		const int32_t* material_id)
+	{
+		// replaces the packed spheres with whole arrays at once, e.g. straight out of a mapped scene file
+		center_x.assign(x, x + count);
+		center_y.assign(y, y + count);
+		center_z.assign(z, z + count);
+		radii.assign(radius, radius + count);
+		material_ids.assign(material_id, material_id + count);
+
+		radii_sq.resize(count);
+		bbox = AABB();
+		for (size_t i = 0; i < count; i++)
+		{
+			radii_sq[i] = radii[i] * radii[i];
+			bbox = AABB(bbox, sphere_bounding_box(int(i)));
+		}
+	}
+
+	void set_sphere(int i, const Point3& center, Real radius)
+	{
+		// moves a sphere in place, the set's own bounds only ever grow
+		center_x[i] = center.x();
+		center_y[i] = center.y();
+		center_z[i] = center.z();
+		radii[i] = radius;
+		radii_sq[i] = radius * radius;
+		bbox = AABB(bbox, sphere_bounding_box(i));
+	}
+
+	void pad()
+	{
+		// padding lanes have a negative squared radius, which keeps their discriminant below zero for every ray
+		while (size() % WIDTH != 0)
+		{
+			center_x.push_back(0);
+			center_y.push_back(0);
+			center_z.push_back(0);
+			radii.push_back(0);
+			radii_sq.push_back(-1);
+			material_ids.push_back(0);
+		}
+	}
+
+	int size() const { return int(radii.size()); }
+
+	Point3 center(int i) const { return Point3(center_x[i], center_y[i], center_z[i]); }
+	Real radius(int i) const { return radii[i]; }
+	int material_id(int i) const { return material_ids[i]; }
+	bool is_padding(int i) const { return radii_sq[i] < 0; }
+
+	AABB sphere_bounding_box(int i) const
+	{
+		Vec3 rvec(radii[i], radii[i], radii[i]);
+		return AABB(center(i) - rvec, center(i) + rvec);
+	}
+
+	const HittableList& unpacked() const { return others; }
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override
+	{
+		bool hit_anything = hit_range(r, ray_t, rec, 0, size());
+		if (others.hit(r, Interval(ray_t.min, hit_anything ? rec.t : ray_t.max), rec))
+			hit_anything = true;
+
+		return hit_anything;
+	}
+
+	bool hit_range(const Ray& r, Interval ray_t, HitRecord& rec, int first, int count) const
+	{
+		// the quadratic of Sphere::hit for WIDTH spheres at a time, keeping the closest root per lane
+		RT_STAT(sphere_tests += count);
+
+		const Real4 orig_x = Real4::broadcast(r.origin().x());
+		const Real4 orig_y = Real4::broadcast(r.origin().y());
+		const Real4 orig_z = Real4::broadcast(r.origin().z());
+		const Real4 d_x = Real4::broadcast(r.direction().x());
+		const Real4 d_y = Real4::broadcast(r.direction().y());
+		const Real4 d_z = Real4::broadcast(r.direction().z());
+		const Real4 a = Real4::broadcast(r.direction().length_squared());
+		const Real4 t_min = Real4::broadcast(ray_t.min);
+		const Real4 zero = Real4::broadcast(0);
+		const Real4 infinity = Real4::broadcast(Real(INF));
+
+		Real4 best_t = Real4::broadcast(ray_t.max);
+		Real4 best_index = Real4::broadcast(-1);		// sphere indices stay exact in float lanes up to 2^24
+
+		for (int base = first; base < first + count; base += WIDTH)
+		{
+			// a group running past the end of the arrays is loaded from a copy whose missing lanes are padding
+			const Real* x = &center_x[base];
+			const Real* y = &center_y[base];
+			const Real* z = &center_z[base];
+			const Real* r_sq = &radii_sq[base];
+			Real tail[4][WIDTH];
+			if (base + WIDTH > size())
+			{
+				for (int lane = 0; lane < WIDTH; lane++)
+				{
+					const bool inside = base + lane < size();
+					tail[0][lane] = inside ? x[lane] : 0;
+					tail[1][lane] = inside ? y[lane] : 0;
+					tail[2][lane] = inside ? z[lane] : 0;
+					tail[3][lane] = inside ? r_sq[lane] : -1;
+				}
+				x = tail[0];
+				y = tail[1];
+				z = tail[2];
+				r_sq = tail[3];
+			}
+
+			const Real4 oc_x = Real4::load(x) - orig_x;
+			const Real4 oc_y = Real4::load(y) - orig_y;
+			const Real4 oc_z = Real4::load(z) - orig_z;
+
+			const Real4 h = d_x * oc_x + d_y * oc_y + d_z * oc_z;
+			const Real4 c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - Real4::load(r_sq);
+			const Real4 discriminant = h * h - a * c;
+
+			const Real4 real_roots = compare_less_equal(zero, discriminant);
+			if (movemask(real_roots) == 0)
+				continue;
+
+			const Real4 sqrtd = sqrt(max(discriminant, zero));
+			const Real4 near_root = (h - sqrtd) / a;
+			const Real4 far_root = (h + sqrtd) / a;
+
+			// the nearest root inside (t_min, best_t), or infinity when neither root is
+			const Real4 near_ok = compare_less(t_min, near_root) & compare_less(near_root, best_t);
+			const Real4 far_ok = compare_less(t_min, far_root) & compare_less(far_root, best_t);
+			const Real4 root = select(real_roots & near_ok, near_root, select(real_roots & far_ok, far_root, infinity));
+
+			const Real4 closer = compare_less(root, best_t);
+			best_t = select(closer, root, best_t);
+			best_index = select(closer, Real4::broadcast(Real(base)) + lane_offsets(), best_index);
+		}
+
+		Real t_lanes[WIDTH], index_lanes[WIDTH];
+		best_t.store(t_lanes);
+		best_index.store(index_lanes);
+
+		int best = -1;
+		Real closest = ray_t.max;
+		for (int lane = 0; lane < WIDTH; lane++)
+		{
+			if (index_lanes[lane] >= 0 && t_lanes[lane] < closest)
+			{
+				closest = t_lanes[lane];
+				best = int(index_lanes[lane]);
+			}
+		}
+
+		if (best < 0)
+			return false;
+
+		set_hit_record(r, closest, best, rec);
+		return true;
+	}
+
+	int hit_packet_range(const RayPacket& packet, int lane_mask, Real t_min, Real* t_max, HitRecord* recs,
+		int first, int count) const
+	{
+		// one sphere against a group of lanes of the packet at a time, padding included in the statistics
+		RT_STAT(sphere_tests += count * RayPacket::lane_count(lane_mask));
+
+		const Real4 zero = Real4::broadcast(0);
+		int hit_mask = 0;
+		for (int g = 0; g < packet.groups(); g++)
+		{
+			const int lanes = RayPacket::group_mask(lane_mask, g);
+			if (lanes == 0)
+				continue;
+
+			const int first_lane = RayPacket::GROUP * g;
+			const Real4 orig_x = Real4::load(packet.orig[0] + first_lane);
+			const Real4 orig_y = Real4::load(packet.orig[1] + first_lane);
+			const Real4 orig_z = Real4::load(packet.orig[2] + first_lane);
+			const Real4 d_x = Real4::load(packet.dir[0] + first_lane);
+			const Real4 d_y = Real4::load(packet.dir[1] + first_lane);
+			const Real4 d_z = Real4::load(packet.dir[2] + first_lane);
+			const Real4 a = d_x * d_x + d_y * d_y + d_z * d_z;
+
+			for (int s = first; s < first + count; s++)
+			{
+				if (radii_sq[s] < 0)
+					continue;
+
+				const Real4 oc_x = Real4::broadcast(center_x[s]) - orig_x;
+				const Real4 oc_y = Real4::broadcast(center_y[s]) - orig_y;
+				const Real4 oc_z = Real4::broadcast(center_z[s]) - orig_z;
+
+				const Real4 h = d_x * oc_x + d_y * oc_y + d_z * oc_z;
+				const Real4 c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - Real4::broadcast(radii_sq[s]);
+				const Real4 discriminant = h * h - a * c;
+
+				int candidates = less_equal(zero, discriminant) & lanes;
+				if (candidates == 0)
+					continue;
+
+				const Real4 sqrtd = sqrt(max(discriminant, zero));
+				Real near_roots[RayPacket::GROUP], far_roots[RayPacket::GROUP];
+				((h - sqrtd) / a).store(near_roots);
+				((h + sqrtd) / a).store(far_roots);
+
+				for (int k = 0; k < RayPacket::GROUP; k++)
+				{
+					if (!(candidates & (1 << k)))
+						continue;
+
+					const int lane = first_lane + k;
+					Interval ray_t(t_min, t_max[lane]);
+					Real root = near_roots[k];
+					if (!ray_t.surrrounds(root))
+					{
+						root = far_roots[k];
+						if (!ray_t.surrrounds(root))
+							continue;
+					}
+
+					set_hit_record(packet.rays[lane], root, s, recs[lane]);
+					t_max[lane] = root;
+					hit_mask |= 1 << lane;
+				}
+			}
+		}
+		return hit_mask;
+	}
+
+	int hit_packet(const RayPacket& packet, int lane_mask, Real t_min, Real* t_max, HitRecord* recs) const override
+	{
+		int hit_mask = hit_packet_range(packet, lane_mask, t_min, t_max, recs, 0, size());
+		return hit_mask | others.hit_packet(packet, lane_mask, t_min, t_max, recs);
+	}
+
+	AABB bounding_box() const override { return AABB(bbox, others.bounding_box()); }
+
+private:
+	std::vector<Real> center_x, center_y, center_z;
+	std::vector<Real> radii;
+	std::vector<Real> radii_sq;
+	std::vector<int> material_ids;
+
+	HittableList others;
+	AABB bbox;
+
+	static Real4 lane_offsets()
+	{
+		static const Real offsets[WIDTH] = { 0, 1, 2, 3 };
+		return Real4::load(offsets);
+	}
+
+	void set_hit_record(const Ray& r, Real root, int s, HitRecord& rec) const
+	{
+		rec.t = root;
+		rec.p = r.at(rec.t);
+		Vec3 outward_normal = (rec.p - Point3(center_x[s], center_y[s], center_z[s])) / radii[s];
+		rec.set_face_normal(r, outward_normal);
+		rec.material_id = material_ids[s];
+	}
+};
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Tile
+{
+	int x0, y0;		// inclusive upper left pixel
+	int x1, y1;		// exclusive lower right pixel
+};
+
+class TileScheduler
+{
+public:
+	// only the rows from first_row up to image_height are tiled
+	TileScheduler(int image_width, int image_height, int tile_size, int num_workers, int first_row = 0)
+	{
+		tile_size = tile_size < 1 ? 1 : tile_size;
+		num_workers = num_workers < 1 ? 1 : num_workers;
+
+		std::vector<Tile> tiles;
+		for (int y = first_row; y < image_height; y += tile_size)
+		{
+			for (int x = 0; x < image_width; x += tile_size)
+			{
+				int x1 = x + tile_size < image_width ? x + tile_size : image_width;
+				int y1 = y + tile_size < image_height ? y + tile_size : image_height;
+				tiles.push_back({ x, y, x1, y1 });
+			}
+		}
+
+		tiles_left = int(tiles.size());
+
+		// every worker starts on its own contiguous band of the image, which keeps its working set of the scene small
+		for (int w = 0; w < num_workers; w++)
+		{
+			auto queue = std::make_unique<WorkerQueue>();
+			size_t first = tiles.size() * w / num_workers;
+			size_t last = tiles.size() * (w + 1) / num_workers;
+			queue->tiles.assign(tiles.begin() + first, tiles.begin() + last);
+			queues.push_back(std::move(queue));
+		}
+	}
+
+	bool next_tile(int worker, Tile& tile)
+	{
+		// take from the front of our own queue, otherwise steal from the back of someone else's
+		const int num_workers = int(queues.size());
+		for (int k = 0; k < num_workers; k++)
+		{
+			WorkerQueue& queue = *queues[(worker + k) % num_workers];
+			std::lock_guard<std::mutex> lock(queue.mtx);
+
+			if (queue.tiles.empty())
+				continue;
+
+			if (k == 0)
+			{
+				tile = queue.tiles.front();
+				queue.tiles.pop_front();
+			}
+			else
+			{
+				tile = queue.tiles.back();
+				queue.tiles.pop_back();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	int tile_done() { return --tiles_left; }
+	int tiles_remaining() const { return tiles_left; }
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mtx;
+		std::deque<Tile> tiles;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::atomic<int> tiles_left;
+};
+
+#endif
@@ -4,14 +4,16 @@
 #define TIMER_H
 
 #include <chrono>
+#include <iostream>
+#include <string>
 
 class Timer
 {
 public:
-	Timer(const std::string timer_name) : timer_name(timer_name), start(std::chrono::high_resolution_clock::now()) {}
+	Timer(const std::string timer_name) : timer_name(timer_name), start(std::chrono::steady_clock::now()) {}
 	~Timer()
 	{
-		auto end = std::chrono::high_resolution_clock::now();
+		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<float> duration = end - start;
 		float duration_in_mins = duration.count() / 60.f;
 
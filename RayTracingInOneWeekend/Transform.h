@@ -0,0 +1,117 @@
+#pragma once
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "AABB.h"
+
+class Transform
+{
+public:
+	// affine map p -> L p + offset, with the linear part L stored as three rows
+	Transform() : rows{ Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1) }, offset(0, 0, 0) {}
+
+	static Transform translate(const Vec3& offset)
+	{
+		Transform t;
+		t.offset = offset;
+		return t;
+	}
+
+	static Transform scale(const Vec3& factors)
+	{
+		Transform t;
+		t.rows[0] = Vec3(factors.x(), 0, 0);
+		t.rows[1] = Vec3(0, factors.y(), 0);
+		t.rows[2] = Vec3(0, 0, factors.z());
+		return t;
+	}
+
+	static Transform scale(Real factor) { return scale(Vec3(factor, factor, factor)); }
+
+	static Transform rotate(const Vec3& axis, double degrees)
+	{
+		// Rodrigues' rotation formula, counter-clockwise when looking down the axis towards the origin
+		Vec3 a = unit_vector(axis);
+		Real c = Real(std::cos(degrees_to_radians(degrees)));
+		Real s = Real(std::sin(degrees_to_radians(degrees)));
+		Real k = 1 - c;
+
+		Transform t;
+		t.rows[0] = Vec3(c + a.x() * a.x() * k, a.x() * a.y() * k - a.z() * s, a.x() * a.z() * k + a.y() * s);
+		t.rows[1] = Vec3(a.y() * a.x() * k + a.z() * s, c + a.y() * a.y() * k, a.y() * a.z() * k - a.x() * s);
+		t.rows[2] = Vec3(a.z() * a.x() * k - a.y() * s, a.z() * a.y() * k + a.x() * s, c + a.z() * a.z() * k);
+		return t;
+	}
+
+	Transform operator*(const Transform& other) const
+	{
+		// applies other first, then this
+		Transform t;
+		for (int i = 0; i < 3; i++)
+		{
+			t.rows[i] = Vec3(
+				dot(rows[i], other.column(0)),
+				dot(rows[i], other.column(1)),
+				dot(rows[i], other.column(2)));
+		}
+		t.offset = point(other.offset);
+		return t;
+	}
+
+	Transform inverse() const
+	{
+		// the inverse of L is its adjugate over its determinant, the adjugate's columns being cross products of rows
+		Vec3 c0 = cross(rows[1], rows[2]);
+		Vec3 c1 = cross(rows[2], rows[0]);
+		Vec3 c2 = cross(rows[0], rows[1]);
+		Real inv_det = 1 / dot(rows[0], c0);
+
+		Transform t;
+		t.rows[0] = inv_det * Vec3(c0.x(), c1.x(), c2.x());
+		t.rows[1] = inv_det * Vec3(c0.y(), c1.y(), c2.y());
+		t.rows[2] = inv_det * Vec3(c0.z(), c1.z(), c2.z());
+		t.offset = -t.vector(offset);
+		return t;
+	}
+
+	Point3 point(const Point3& p) const { return vector(p) + offset; }
+
+	Vec3 vector(const Vec3& v) const
+	{
+		return Vec3(dot(rows[0], v), dot(rows[1], v), dot(rows[2], v));
+	}
+
+	Vec3 transposed_vector(const Vec3& v) const
+	{
+		// L^T v, which takes normals out of a space whose inverse transform this is
+		return v.x() * rows[0] + v.y() * rows[1] + v.z() * rows[2];
+	}
+
+	AABB box(const AABB& b) const
+	{
+		// Arvo's method: each output interval gathers the smaller and larger product of every row entry
+		// with the input interval on that axis, which bounds all eight transformed corners
+		Real lo[3], hi[3];
+		for (int i = 0; i < 3; i++)
+		{
+			lo[i] = hi[i] = offset[i];
+			for (int j = 0; j < 3; j++)
+			{
+				Real a = rows[i][j] * b.axis_interval(j).min;
+				Real c = rows[i][j] * b.axis_interval(j).max;
+				lo[i] += std::fmin(a, c);
+				hi[i] += std::fmax(a, c);
+			}
+		}
+		return AABB(Point3(lo[0], lo[1], lo[2]), Point3(hi[0], hi[1], hi[2]));
+	}
+
+private:
+	Vec3 rows[3];
+	Vec3 offset;
+
+	Vec3 column(int j) const { return Vec3(rows[0][j], rows[1][j], rows[2][j]); }
+};
+
+#endif
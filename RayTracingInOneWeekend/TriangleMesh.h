@@ -0,0 +1,239 @@
+#pragma once
+
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "BVH.h"
+#include "SIMD.h"
+
+#include <vector>
+
+struct MeshNode
+{
+	AABB bbox;
+	int offset;		// a leaf's first triangle, or for interior nodes the index of the second child, the first follows the node
+	int count;		// triangles in a leaf, 0 for interior nodes
+	int axis;		// split axis of interior nodes
+};
+
+class TriangleMesh : public Hittable
+{
+public:
+	static const int WIDTH = 4;		// triangles tested per instruction, also the largest leaf
+	static const int STACK_SIZE = 256;
+
+	// one Hittable for a whole mesh: vertices are shared between triangles through the index buffer and the mesh keeps
+	// its own BVH whose leaves are contiguous triangle ranges, the index buffer is reordered to match
+	TriangleMesh(std::vector<Point3> mesh_vertices, const std::vector<int>& mesh_indices, int material_id)
+		: vertices(std::move(mesh_vertices)), mat_id(material_id)
+	{
+		const int count = int(mesh_indices.size() / 3);
+		std::vector<BVHPrimitive> build_prims;
+		build_prims.reserve(count);
+		for (int i = 0; i < count; i++)
+		{
+			const Point3& a = vertices[mesh_indices[3 * i + 0]];
+			const Point3& b = vertices[mesh_indices[3 * i + 1]];
+			const Point3& c = vertices[mesh_indices[3 * i + 2]];
+			AABB box(AABB(a, b), AABB(c, c));
+			build_prims.push_back({ box, box.centroid(), i });
+		}
+
+		BVHBuilder builder;
+		builder.max_leaf_size = WIDTH;
+		builder.traversal_cost = WIDTH / 2;
+		if (count > 0)
+			builder.build(build_prims);
+
+		indices.reserve(3 * size_t(count));
+		for (const BVHPrimitive& prim : build_prims)
+		{
+			for (int k = 0; k < 3; k++)
+				indices.push_back(mesh_indices[3 * prim.index + k]);
+		}
+
+		// the builder emits nodes depth first with every left child right after its parent, which is the layout kept here
+		nodes.reserve(builder.nodes.size());
+		for (const BVHBuildNode& build_node : builder.nodes)
+		{
+			int offset = build_node.is_leaf() ? build_node.first : build_node.right;
+			nodes.push_back({ build_node.bbox, offset, build_node.count, build_node.axis });
+		}
+		if (!nodes.empty())
+			bbox = nodes[0].bbox;
+
+		nodes.shrink_to_fit();
+	}
+
+	int triangle_count() const { return int(indices.size() / 3); }
+	int vertex_count() const { return int(vertices.size()); }
+
+	size_t memory_bytes() const
+	{
+		return vertices.capacity() * sizeof(Point3) + indices.capacity() * sizeof(int) + nodes.capacity() * sizeof(MeshNode);
+	}
+
+	bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override
+	{
+		if (nodes.empty())
+			return false;
+
+		RayShear shear(r);
+		int stack[STACK_SIZE];
+		int stack_size = 0;
+		int node_index = 0;
+		int best_triangle = -1;
+
+		while (true)
+		{
+			const MeshNode& node = nodes[node_index];
+			RT_STAT(bvh_nodes++);
+
+			if (node.bbox.hit(r, ray_t))
+			{
+				if (node.count > 0)
+				{
+					int best = hit_leaf(shear, ray_t, node.offset, node.count);
+					if (best >= 0)
+						best_triangle = best;
+				}
+				else
+				{
+					// descend into the near child first, so the far one can be culled by a closer hit
+					if (r.sign(node.axis))
+					{
+						stack[stack_size++] = node_index + 1;
+						node_index = node.offset;
+					}
+					else
+					{
+						stack[stack_size++] = node.offset;
+						node_index = node_index + 1;
+					}
+					continue;
+				}
+			}
+
+			if (stack_size == 0)
+				break;
+			node_index = stack[--stack_size];
+		}
+
+		if (best_triangle < 0)
+			return false;
+
+		const Point3& a = vertices[indices[3 * best_triangle + 0]];
+		const Point3& b = vertices[indices[3 * best_triangle + 1]];
+		const Point3& c = vertices[indices[3 * best_triangle + 2]];
+
+		rec.t = ray_t.max;
+		rec.p = r.at(rec.t);
+		rec.set_face_normal(r, unit_vector(cross(b - a, c - a)));
+		rec.material_id = mat_id;
+		return true;
+	}
+
+	AABB bounding_box() const override { return bbox; }
+
+private:
+	std::vector<Point3> vertices;
+	std::vector<int> indices;		// three per triangle, in leaf order
+	std::vector<MeshNode> nodes;
+	int mat_id;
+	AABB bbox;
+
+	struct RayShear
+	{
+		// per ray constants of the watertight test of Woop, Benthin and Wald: the ray is moved to the origin and
+		// sheared onto the +z axis, so edge functions of the projected triangle decide a hit without gaps between
+		// triangles that share an edge
+		int kx, ky, kz;
+		Real sx, sy, sz;
+		Point3 origin;
+
+		RayShear(const Ray& r) : origin(r.origin())
+		{
+			const Vec3& d = r.direction();
+			kz = std::fabs(d.x()) > std::fabs(d.y())
+				? (std::fabs(d.x()) > std::fabs(d.z()) ? 0 : 2)
+				: (std::fabs(d.y()) > std::fabs(d.z()) ? 1 : 2);
+			kx = kz == 2 ? 0 : kz + 1;
+			ky = kx == 2 ? 0 : kx + 1;
+
+			// keeps the winding of the projected triangle
+			if (d[kz] < 0)
+				std::swap(kx, ky);
+
+			sx = d[kx] / d[kz];
+			sy = d[ky] / d[kz];
+			sz = 1 / d[kz];
+		}
+	};
+
+	int hit_leaf(const RayShear& shear, Interval& ray_t, int first, int count) const
+	{
+		// WIDTH triangles at a time, shrinks ray_t.max to the closest hit and returns its triangle, or -1
+		int best = -1;
+		for (int base = first; base < first + count; base += WIDTH)
+		{
+			RT_STAT(triangle_tests += WIDTH);
+
+			// gather the sheared-frame coordinates of every vertex, unused lanes repeat the last triangle
+			Real coords[9][WIDTH];
+			for (int lane = 0; lane < WIDTH; lane++)
+			{
+				int tri = base + lane < first + count ? base + lane : first + count - 1;
+				for (int k = 0; k < 3; k++)
+				{
+					const Point3& v = vertices[indices[3 * tri + k]];
+					coords[3 * k + 0][lane] = v[shear.kx] - shear.origin[shear.kx];
+					coords[3 * k + 1][lane] = v[shear.ky] - shear.origin[shear.ky];
+					coords[3 * k + 2][lane] = v[shear.kz] - shear.origin[shear.kz];
+				}
+			}
+
+			const Real4 sx = Real4::broadcast(shear.sx);
+			const Real4 sy = Real4::broadcast(shear.sy);
+			const Real4 sz = Real4::broadcast(shear.sz);
+
+			const Real4 az = Real4::load(coords[2]), bz = Real4::load(coords[5]), cz = Real4::load(coords[8]);
+			const Real4 ax = Real4::load(coords[0]) - sx * az, ay = Real4::load(coords[1]) - sy * az;
+			const Real4 bx = Real4::load(coords[3]) - sx * bz, by = Real4::load(coords[4]) - sy * bz;
+			const Real4 cx = Real4::load(coords[6]) - sx * cz, cy = Real4::load(coords[7]) - sy * cz;
+
+			// scaled barycentrics, a hit needs all three on the same side
+			const Real4 u = cx * by - cy * bx;
+			const Real4 v = ax * cy - ay * cx;
+			const Real4 w = bx * ay - by * ax;
+			const Real4 zero = Real4::broadcast(0);
+			int inside = (less_equal(zero, u) & less_equal(zero, v) & less_equal(zero, w))
+				| (less_equal(u, zero) & less_equal(v, zero) & less_equal(w, zero));
+
+			const Real4 det = u + v + w;
+			inside &= less_than(zero, det) | less_than(det, zero);
+			if (base + WIDTH > first + count)
+				inside &= (1 << (first + count - base)) - 1;
+			if (inside == 0)
+				continue;
+
+			const Real4 t = (u * (sz * az) + v * (sz * bz) + w * (sz * cz)) / det;
+			inside &= less_than(Real4::broadcast(ray_t.min), t) & less_than(t, Real4::broadcast(ray_t.max));
+			if (inside == 0)
+				continue;
+
+			Real t_lanes[WIDTH];
+			t.store(t_lanes);
+			for (int lane = 0; lane < WIDTH; lane++)
+			{
+				if ((inside & (1 << lane)) && t_lanes[lane] < ray_t.max)
+				{
+					ray_t.max = t_lanes[lane];
+					best = base + lane;
+				}
+			}
+		}
+		return best;
+	}
+};
+
+#endif
@@ -3,23 +3,26 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-class Vec3
+template<typename T>
+class Vec3T
 {
 public:
-	double e[3];
+	typedef T Scalar;
+
+	T e[3];
 	
-	Vec3() : e{ 0, 0, 0 } {}
-	Vec3(double e1, double e2, double e3) : e{ e1, e2, e3 } {}
+	Vec3T() : e{ 0, 0, 0 } {}
+	Vec3T(T e1, T e2, T e3) : e{ e1, e2, e3 } {}
 
-	double x() const { return e[0]; }
-	double y() const { return e[1]; }
-	double z() const { return e[2]; }
+	T x() const { return e[0]; }
+	T y() const { return e[1]; }
+	T z() const { return e[2]; }
 
-	Vec3 operator-() const { return Vec3(-e[0], -e[1], -e[2]); }
-	double operator[](int i) const { return e[i]; }
-	double& operator[](int i) { return e[i]; }
+	Vec3T operator-() const { return Vec3T(-e[0], -e[1], -e[2]); }
+	T operator[](int i) const { return e[i]; }
+	T& operator[](int i) { return e[i]; }
 
-	Vec3& operator+=(const Vec3& v)
+	Vec3T& operator+=(const Vec3T& v)
 	{
 		e[0] += v.e[0];
 		e[1] += v.e[1];
@@ -27,7 +30,7 @@ public:
 		return *this;
 	}
 
-	Vec3& operator*=(double t)
+	Vec3T& operator*=(T t)
 	{
 		e[0] *= t;
 		e[1] *= t;
@@ -35,124 +38,157 @@ public:
 		return *this;
 	}
 
-	Vec3& operator/=(double t)
+	Vec3T& operator/=(T t)
 	{
 		return *this *= 1 / t;
 	}
 
-	double length() const
+	T length() const
 	{
-		return sqrt(length_squared());
+		return std::sqrt(length_squared());
 	}
 
-	double length_squared() const
+	T length_squared() const
 	{
 		return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
 	}
 
 	bool near_zero() const {
 		// return true if the vector is close to zero in all dimensions
-		double s = 1e-8;
+		T s = Epsilon<T>::near_zero();
 		return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
 	}
 
-	static Vec3 random()
+	static Vec3T random()
 	{
-		return Vec3(random_double(), random_double(), random_double());
+		return Vec3T(T(random_double()), T(random_double()), T(random_double()));
 	}
 
-	static Vec3 random(double min, double max)
+	static Vec3T random(double min, double max)
 	{
-		return Vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+		return Vec3T(T(random_double(min, max)), T(random_double(min, max)), T(random_double(min, max)));
 	}
 };
 
 
+using Vec3 = Vec3T<Real>;
+
 // Point3 is just an alias for Vec3, but useful for geometric clarity in the code.
 using Point3 = Vec3;
 
 
 // Vector Utility Functions
+// scalars are taken as Vec3T<T>::Scalar so that T is deduced from the vector alone and e.g. 0.5 * v works for float
 
-inline std::ostream& operator<<(std::ostream& out, const Vec3& v)
+template<typename T>
+inline std::ostream& operator<<(std::ostream& out, const Vec3T<T>& v)
 {
 	return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline Vec3 operator+(const Vec3& u, const Vec3& v)
+template<typename T>
+inline Vec3T<T> operator+(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-	return Vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+	return Vec3T<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline Vec3 operator-(const Vec3& u, const Vec3& v)
+template<typename T>
+inline Vec3T<T> operator-(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-	return Vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+	return Vec3T<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline Vec3 operator*(const Vec3& u, const Vec3& v)
+template<typename T>
+inline Vec3T<T> operator*(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-	return Vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+	return Vec3T<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline Vec3 operator*(double t, const Vec3& v)
+template<typename T>
+inline Vec3T<T> operator*(typename Vec3T<T>::Scalar t, const Vec3T<T>& v)
 {
-	return Vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+	return Vec3T<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-inline Vec3 operator*(const Vec3& v, double t)
+template<typename T>
+inline Vec3T<T> operator*(const Vec3T<T>& v, typename Vec3T<T>::Scalar t)
 {
 	return t * v;
 }
 
-inline Vec3 operator/(const Vec3& v, double t)
+template<typename T>
+inline Vec3T<T> operator/(const Vec3T<T>& v, typename Vec3T<T>::Scalar t)
 {
 	return (1 / t) * v;
 }
 
-inline double dot(const Vec3& u, const Vec3& v)
+template<typename T>
+inline T dot(const Vec3T<T>& u, const Vec3T<T>& v)
 {
 	return u.e[0] * v.e[0]
 		+ u.e[1] * v.e[1]
 		+ u.e[2] * v.e[2];
 }
 
-inline Vec3 cross(const Vec3& u, const Vec3& v)
+template<typename T>
+inline Vec3T<T> cross(const Vec3T<T>& u, const Vec3T<T>& v)
 {
-	return Vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+	return Vec3T<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
 		u.e[2] * v.e[0] - u.e[0] * v.e[2],
 		u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline Vec3 unit_vector(const Vec3& v)
+template<typename T>
+inline Vec3T<T> unit_vector(const Vec3T<T>& v)
 {
 	return v / v.length();
 }
 
-inline Vec3 random_in_unit_disk()
+inline Vec3 unit_disk_from_square(double u, double v)
 {
-	while (true)
+	// Shirley and Chiu's concentric mapping of [0, 1)^2 onto the unit disk, area preserving and without rejection,
+	// so neighbouring, well spread samples of the square stay neighbouring, well spread points of the disk
+	double a = 2 * u - 1, b = 2 * v - 1;
+	if (a == 0 && b == 0)
+		return Vec3(0, 0, 0);
+
+	double r, phi;
+	if (a * a > b * b)
 	{
-		Vec3 p = Vec3(random_double(-1, 1), random_double(-1, 1), 0);
-		if (p.length_squared() < 1)
-			return p;
+		r = a;
+		phi = (PI / 4) * (b / a);
 	}
+	else
+	{
+		r = b;
+		phi = PI / 2 - (PI / 4) * (a / b);
+	}
+	return Vec3(Real(r * std::cos(phi)), Real(r * std::sin(phi)), 0);
+}
+
+inline Vec3 unit_vector_from_square(double u, double v)
+{
+	// uniform direction from [0, 1)^2: z is uniform in [-1, 1] by Archimedes' hat-box theorem, the angle around z in [0, 2pi)
+	double z = 1 - 2 * u;
+	double r = std::sqrt(std::fmax(0.0, 1 - z * z));
+	double phi = 2 * PI * v;
+	return Vec3(Real(r * std::cos(phi)), Real(r * std::sin(phi)), Real(z));
+}
+
+inline Vec3 random_in_unit_disk()
+{
+	return unit_disk_from_square(random_double(), random_double());
 }
 
 inline Vec3 random_in_unit_sphere()
 {
-	while (true)
-	{
-		Vec3 p = Vec3::random(-1, 1);
-		if (p.length_squared() < 1)
-		{
-			return p;
-		}
-	}
+	// a uniform direction scaled by the cube root of a uniform number is uniform in the ball's volume
+	return unit_vector_from_square(random_double(), random_double()) * Real(std::cbrt(random_double()));
 }
 
 inline Vec3 random_unit_vector()
 {
-	return unit_vector(random_in_unit_sphere());
+	return unit_vector_from_square(random_double(), random_double());
 }
 
 inline Vec3 random_on_hemisphere(const Vec3 normal)
@@ -165,16 +201,18 @@ inline Vec3 random_on_hemisphere(const Vec3 normal)
 	return -on_unit_sphere;
 }
 
-inline Vec3 reflect(const Vec3& v, const Vec3 n)
+template<typename T>
+inline Vec3T<T> reflect(const Vec3T<T>& v, const Vec3T<T> n)
 {
 	return v - 2 * dot(v, n) * n;
 }
 
-inline Vec3 refract(const Vec3& uv, const Vec3 n, double etai_over_etat)
+template<typename T>
+inline Vec3T<T> refract(const Vec3T<T>& uv, const Vec3T<T> n, T etai_over_etat)
 {
-	double cos_theta = fmin(dot(-uv, n), 1.0);
-	Vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-	Vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+	T cos_theta = std::fmin(dot(-uv, n), T(1));
+	Vec3T<T> r_out_perp = etai_over_etat * (uv + cos_theta * n);
+	Vec3T<T> r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
 	return r_out_perp + r_out_parallel;
 }
 
@@ -0,0 +1,245 @@
+#pragma once
+
+#ifndef WAVEFRONT_INTEGRATOR_H
+#define WAVEFRONT_INTEGRATOR_H
+
+#include "Features.h"
+#include "Hittable.h"
+#include "Light.h"
+#include "MaterialTable.h"
+#include "Sky.h"
+
+#include <vector>
+
+class WavefrontIntegrator
+{
+public:
+	// instead of following one path to its end, every path in the batch is advanced one bounce at a time:
+	// extend intersects all live paths, then the miss, light and per-material shade kernels each run over their own
+	// queue, and the shadow rays the diffuse kernel queued for next-event estimation are traced last
+	WavefrontIntegrator(const Hittable& world, const MaterialTable& materials, const LightList& lights, int max_depth)
+		: world(world), materials(materials), lights(lights), max_depth(max_depth) {}
+
+	// same meaning as the Camera options of the same name
+	bool russian_roulette = false;
+	int roulette_min_depth = 5;
+	bool next_event_estimation = true;
+
+	bool collect_features = false;		// keep what each path's camera ray first sees, see features()
+
+	void clear()
+	{
+		rays.clear();
+		throughput.clear();
+		depth.clear();
+		rngs.clear();
+		samplers.clear();
+		scatter_pdfs.clear();
+		hits.clear();
+		radiance.clear();
+		first_hits.clear();
+	}
+
+	int size() const { return int(rays.size()); }
+
+	int add_path(const Ray& r, const PCG32& rng, const SamplerState& sampler)
+	{
+		// rng and sampler are the generator state the path continues from, so each path draws the numbers ray_color would
+		rays.push_back(r);
+		throughput.push_back(Color(1, 1, 1));
+		depth.push_back(max_depth);
+		rngs.push_back(rng);
+		samplers.push_back(sampler);
+		scatter_pdfs.push_back(0);
+		hits.push_back(HitRecord());
+		radiance.push_back(Color(0, 0, 0));
+		if (collect_features)
+			first_hits.push_back(SampleFeatures());
+		return size() - 1;
+	}
+
+	void run()
+	{
+		active.clear();
+		for (int p = 0; p < size(); p++)
+		{
+			if (depth[p] > 0)
+				active.push_back(p);
+		}
+
+		while (!active.empty())
+		{
+			extend();
+
+			miss();
+			emit();
+			next_active.clear();
+			shadow_queue.clear();
+			shade_queue<&Material::scatter_lambertian>(shade_queues[int(MaterialType::Lambertian)]);
+			shade_queue<&Material::scatter_metal>(shade_queues[int(MaterialType::Metal)]);
+			shade_queue<&Material::scatter_dielectric>(shade_queues[int(MaterialType::Dielectric)]);
+			shadow();
+
+			active.swap(next_active);
+		}
+	}
+
+	const Color& result(int path) const { return radiance[path]; }
+	const SampleFeatures& features(int path) const { return first_hits[path]; }
+
+private:
+	typedef bool (Material::*ScatterFunction)(const Ray&, const HitRecord&, Color&, Ray&) const;
+
+	const Hittable& world;
+	const MaterialTable& materials;
+	const LightList& lights;
+	int max_depth;
+
+	// path state in SoA layout, indexed by path
+	std::vector<Ray> rays;
+	std::vector<Color> throughput;		// product of the attenuations along the path so far
+	std::vector<int> depth;				// bounces left
+	std::vector<PCG32> rngs;
+	std::vector<SamplerState> samplers;
+	std::vector<Real> scatter_pdfs;		// as Camera::shade's scatter_pdf, for the ray each path is on
+	std::vector<HitRecord> hits;
+	std::vector<Color> radiance;
+	std::vector<SampleFeatures> first_hits;		// only with collect_features
+
+	// compacted queues of path indices, rebuilt every bounce
+	std::vector<int> active;
+	std::vector<int> next_active;
+	std::vector<int> miss_queue;
+	std::vector<int> shade_queues[int(MaterialType::Count)];		// the DiffuseLight one holds paths that hit a light
+
+	struct ShadowRay
+	{
+		int path;
+		Ray ray;
+		Real distance;
+		Color weight;		// throughput times what sample_light_ray weighs the light by
+	};
+	std::vector<ShadowRay> shadow_queue;
+
+	void extend()
+	{
+		miss_queue.clear();
+		for (std::vector<int>& queue : shade_queues)
+			queue.clear();
+
+		RT_STAT(rays += active.size());
+		for (int p : active)
+		{
+			bool hit = world.hit(rays[p], Interval(Epsilon<Real>::ray_t_min(), Real(INF)), hits[p]);
+			if (collect_features && depth[p] == max_depth)
+				first_hits[p] = first_hit_features(rays[p], hit, hits[p], materials);
+
+			if (hit)
+				shade_queues[int(materials[hits[p].material_id].type())].push_back(p);
+			else
+				miss_queue.push_back(p);
+		}
+	}
+
+	void miss()
+	{
+		for (int p : miss_queue)
+		{
+			radiance[p] += throughput[p] * sky_color(rays[p]);
+			RT_STAT(end_path(PathEnd::Miss, max_depth - depth[p] + 1));
+		}
+	}
+
+	void emit()
+	{
+		// lights end their paths
+		for (int p : shade_queues[int(MaterialType::DiffuseLight)])
+		{
+			Real weight = scattered_light_weight(lights, rays[p], scatter_pdfs[p]);
+			radiance[p] += throughput[p] * (weight * materials[hits[p].material_id].emitted(hits[p]));
+			RT_STAT(end_path(PathEnd::Light, max_depth - depth[p] + 1));
+		}
+	}
+
+	void shadow()
+	{
+		// the shadow rays of this bounce's diffuse hits, each adds the light it sees to its path
+		RT_STAT(rays += shadow_queue.size());
+		RT_STAT(shadow_rays += shadow_queue.size());
+		for (const ShadowRay& shadow_ray : shadow_queue)
+		{
+			HitRecord rec;
+			if (world.hit(shadow_ray.ray, Interval(Epsilon<Real>::ray_t_min(), shadow_ray.distance), rec))
+				radiance[shadow_ray.path] += shadow_ray.weight * materials[rec.material_id].emitted(rec);
+		}
+	}
+
+	template<ScatterFunction Scatter>
+	void shade_queue(const std::vector<int>& queue)
+	{
+		// every material in a queue has the same type, so its scatter function is fixed at compile time
+		for (int p : queue)
+		{
+			const Material& mat = materials[hits[p].material_id];
+
+			thread_rng() = rngs[p];
+			thread_sampler() = samplers[p];
+			start_bounce(max_depth - depth[p]);
+			Ray scattered;
+			Color attenuation;
+			bool scattered_ok = (mat.*Scatter)(rays[p], hits[p], attenuation, scattered);
+
+			// the light draws follow the scatter draws and the roulette draw comes last, in the same order as in Camera::shade
+			Real scatter_pdf = 0;
+			if (scattered_ok && next_event_estimation && !lights.empty() && mat.type() == MaterialType::Lambertian
+				&& depth[p] > 1)
+			{
+				ShadowRay shadow_ray;
+				if (sample_light_ray(lights, hits[p], mat, max_depth - depth[p], shadow_ray.ray, shadow_ray.distance,
+					shadow_ray.weight))
+				{
+					shadow_ray.path = p;
+					shadow_ray.weight = throughput[p] * shadow_ray.weight;
+					shadow_queue.push_back(shadow_ray);
+				}
+				scatter_pdf = lambertian_pdf(hits[p].normal, scattered.direction());
+			}
+
+			Color next_throughput = throughput[p] * attenuation;
+			bool survived = true;
+			if (scattered_ok && russian_roulette && max_depth - depth[p] + 1 >= roulette_min_depth)
+			{
+				double survival = roulette_survival(next_throughput);
+				survived = roulette_sample(max_depth - depth[p]) < survival;
+				next_throughput = next_throughput / Real(survival);
+			}
+			rngs[p] = thread_rng();
+			samplers[p] = thread_sampler();
+
+			// absorbed paths and paths out of bounces carry no light, exactly as in ray_color
+			if (!scattered_ok)
+			{
+				RT_STAT(end_path(PathEnd::Absorbed, max_depth - depth[p] + 1));
+				continue;
+			}
+			if (!survived)
+			{
+				RT_STAT(end_path(PathEnd::Roulette, max_depth - depth[p] + 1));
+				continue;
+			}
+			if (depth[p] <= 1)
+			{
+				RT_STAT(end_path(PathEnd::DepthCap, max_depth));
+				continue;
+			}
+
+			throughput[p] = next_throughput;
+			rays[p] = scattered;
+			scatter_pdfs[p] = scatter_pdf;
+			depth[p]--;
+			next_active.push_back(p);
+		}
+	}
+};
+
+#endif
@@ -2,19 +2,49 @@
 
 #include "Hittable.h"
 #include "HittableList.h"
-#include "Sphere.h"
-#include "Material.h"
+#include "FlatBVH.h"
+#include "Instance.h"
+#include "MaterialTable.h"
+#include "ObjLoader.h"
+#include "PartialBuffer.h"
 #include "Camera.h"
+#include "SceneBuilder.h"
+#include "SceneFile.h"
+#include "Sequence.h"
+#include "Sphere.h"
 #include "Timer.h"
+#include "TriangleMesh.h"
 
-int main()
-{
-	Timer timer("Render");
+#include <cstdio>
+#include <cstring>
 
-	HittableList world;
+// usage: RayTracingInOneWeekend [scene file] [--save-scene <path>] [--instances <count>] [--obj <path>] [--frames <count>]
+//                                [--rows <first>:<end>] [--samples <first>:<end>] [--partial <path>]
+//                                [--spp <count>] [--checkpoint <path>] [--checkpoint-seconds <seconds>] [--resume <path>]
+//                                [--denoise] [--albedo <path>] [--normal <path>] [--sampler <name>]
+//                                [--time-budget <seconds>] [--target-noise <noise>] [--preview-seconds <seconds>]
+// without a scene file the final scene of the first book is rendered, --save-scene writes the scene out instead,
+// --instances renders a field of count instances of one shared cluster of spheres and --obj a triangle mesh,
+// --frames renders a sequence of count frames orbiting the scene while its small spheres bounce,
+// --rows and --samples render one share of the image and --partial saves it for MergePartials instead of an image,
+// --checkpoint saves the samples taken so far every so often, --resume continues from them and --spp overrides the
+// scene's samples per pixel, e.g. to add samples to a finished render,
+// --denoise filters the image guided by first-hit albedo and normals, which --albedo and --normal write out as images,
+// --sampler picks independent, stratified, sobol (the default) or bluenoise samples,
+// --time-budget and --target-noise render progressively until either is met, writing the image every --preview-seconds
+static const char* USAGE = " [scene file] [--save-scene <path>] [--instances <count>] [--obj <path>] [--frames <count>]"
+	" [--rows <first>:<end>] [--samples <first>:<end>] [--partial <path>]"
+	" [--spp <count>] [--checkpoint <path>] [--checkpoint-seconds <seconds>] [--resume <path>]"
+	" [--denoise] [--albedo <path>] [--normal <path>] [--sampler <independent|stratified|sobol|bluenoise>]"
+	" [--time-budget <seconds>] [--target-noise <noise>] [--preview-seconds <seconds>] [--no-nee]\n";
 
-	auto material_ground = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-	world.add(std::make_shared<Sphere>(Point3(0, -1000.0, 0), 1000.0, material_ground));
+static void book_scene(Scene& scene)
+{
+	SphereSet& world = scene.spheres;
+	MaterialTable& materials = scene.materials;
+
+	int material_ground = materials.add(Lambertian(Color(0.5, 0.5, 0.5)));
+	world.add(Point3(0, -1000.0, 0), 1000.0, material_ground);
 
 	for (int a = -11; a < 11; a++)
 	{
@@ -25,44 +55,43 @@ int main()
 
 			if ((center - Point3(4.0, 0.2, 0.0)).length() > 0.9)
 			{
-				std::shared_ptr<Material> sphere_mat;
+				int sphere_mat;
 
 				if (choose_mat < 0.6)
 				{
 					// diffuse
 					Color albedo = Color::random() * Color::random();
-					sphere_mat = std::make_shared<Lambertian>(albedo);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_mat));
+					sphere_mat = materials.add(Lambertian(albedo));
+					world.add(center, 0.2, sphere_mat);
 				}
 				else if (choose_mat < 0.9)
 				{
 					// metal
 					Color albedo = Color::random(0.5, 1.0);
 					double fuzz = random_double(0, 0.5);
-					sphere_mat = std::make_shared<Metal>(albedo, fuzz);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_mat));
+					sphere_mat = materials.add(Metal(albedo, fuzz));
+					world.add(center, 0.2, sphere_mat);
 				}
 				else
 				{
 					// glass
-					sphere_mat = std::make_shared<Dielectric>(1.5);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_mat));
+					sphere_mat = materials.add(Dielectric(1.5));
+					world.add(center, 0.2, sphere_mat);
 				}
 			}
 		}
 	}
 
-	auto material_one = std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-	world.add(std::make_shared<Sphere>(Point3(-4.0, 1.0, 0), 1.0, material_one));
+	int material_one = materials.add(Lambertian(Color(0.4, 0.2, 0.1)));
+	world.add(Point3(-4.0, 1.0, 0), 1.0, material_one);
 
-	auto material_two = std::make_shared<Dielectric>(1.5);
-	world.add(std::make_shared<Sphere>(Point3(0, 1.0, 0), 1.0, material_two));
+	int material_two = materials.add(Dielectric(1.5));
+	world.add(Point3(0, 1.0, 0), 1.0, material_two);
 
-	auto material_three = std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0);
-	world.add(std::make_shared<Sphere>(Point3(4.0, 1.0, 0), 1.0, material_three));
-	
+	int material_three = materials.add(Metal(Color(0.7, 0.6, 0.5), 0));
+	world.add(Point3(4.0, 1.0, 0), 1.0, material_three);
 
-	Camera camera(world);
+	SceneCamera& camera = scene.camera;
 	camera.aspect_ratio = 16.0 / 9.0;
 	camera.image_width = 1920;
 	camera.samples_per_pixel = 500;
@@ -75,8 +104,351 @@ int main()
 
 	camera.defocus_angle = 0.6;
 	camera.focus_dist = 10.0;
+}
+
+static void instanced_scene(SceneBuilder& builder, SceneCamera& camera, int count)
+{
+	// one cluster of spheres with its own BVH, placed count times on a grid with a random turn and size each,
+	// every instance shares the cluster's geometry so memory grows only by an Instance per copy
+	SphereSet cluster;
+	for (int i = 0; i < 24; i++)
+	{
+		Real radius = Real(random_double(0.1, 0.3));
+		Point3 center(Real(random_double(-0.8, 0.8)), radius, Real(random_double(-0.8, 0.8)));
+		int sphere_mat = random_double() < 0.7
+			? builder.add_material(Lambertian(Color::random() * Color::random()))
+			: builder.add_material(Metal(Color::random(0.5, 1.0), Real(random_double(0, 0.3))));
+		cluster.add(center, radius, sphere_mat);
+	}
+	const FlatBVH& cluster_bvh = builder.make<FlatBVH>(cluster);
+
+	int side = int(std::ceil(std::sqrt(double(count))));
+	for (int i = 0; i < count; i++)
+	{
+		Vec3 position(Real(2.0 * (i % side - side / 2)), 0, Real(-2.0 * (i / side)));
+		Transform placement = Transform::translate(position)
+			* Transform::rotate(Vec3(0, 1, 0), random_double(0, 360))
+			* Transform::scale(Real(random_double(0.6, 1.0)));
+		builder.add<Instance>(cluster_bvh, placement);
+	}
+
+	builder.add_sphere(Point3(0, -1000.0, 0), 1000.0, builder.add_material(Lambertian(Color(0.5, 0.5, 0.5))));
+
+	camera.aspect_ratio = 16.0 / 9.0;
+	camera.image_width = 1920;
+	camera.samples_per_pixel = 100;
+	camera.max_depth = 50;
+
+	camera.vfov = 30;
+	camera.lookfrom = Point3(0, 6, 8);
+	camera.lookat = Point3(0, 0, -12);
+	camera.vup = Vec3(0, 1, 0);
+}
+
+static bool mesh_scene(SceneBuilder& builder, SceneCamera& camera, const std::string& obj_path, uint32_t& content_hash)
+{
+	// the mesh standing on a ground sphere, with the camera framing its bounding box from the front right
+	// content_hash identifies the mesh, everything else about the scene is fixed
+	std::vector<Point3> vertices;
+	std::vector<int> indices;
+	if (!load_obj(obj_path, vertices, indices))
+		return false;
+
+	content_hash = fnv1a(nullptr, 0);
+	for (const Point3& v : vertices)
+	{
+		const double position[] = { double(v.x()), double(v.y()), double(v.z()) };
+		content_hash = fnv1a(position, sizeof(position), content_hash);
+	}
+	content_hash = fnv1a(indices.data(), indices.size() * sizeof(int), content_hash);
+
+	const TriangleMesh& mesh = builder.add<TriangleMesh>(std::move(vertices), indices,
+		builder.add_material(Lambertian(Color(0.7, 0.45, 0.3))));
+	std::clog << mesh.triangle_count() << " triangles";
+	if (mesh.triangle_count() > 0)
+		std::clog << ", " << mesh.memory_bytes() / mesh.triangle_count() << " bytes per triangle";
+	std::clog << "\n";
+
+	AABB box = mesh.bounding_box();
+	Point3 center = box.centroid();
+	Real size = std::fmax(box.x.size(), std::fmax(box.y.size(), box.z.size()));
+	builder.add_sphere(Point3(center.x(), box.y.min - 1000 * size, center.z()), 1000 * size,
+		builder.add_material(Lambertian(Color(0.5, 0.5, 0.5))));
+
+	camera.aspect_ratio = 16.0 / 9.0;
+	camera.image_width = 1920;
+	camera.samples_per_pixel = 100;
+	camera.max_depth = 50;
+
+	camera.vfov = 30;
+	camera.lookat = center;
+	camera.lookfrom = center + size * Vec3(1.0, 0.6, 2.0);
+	camera.vup = Vec3(0, 1, 0);
+	return true;
+}
+
+static bool render_sequence(Camera& camera, Scene& scene, FlatBVH& bvh, int frame_count)
+{
+	// a quarter orbit about the scene camera's target, keyed every eighth of a turn
+	CameraPath path;
+	const Vec3 offset = scene.camera.lookfrom - scene.camera.lookat;
+	for (int k = 0; k <= 2; k++)
+	{
+		double angle = k * PI / 4;
+		Vec3 rotated(std::cos(angle) * offset.x() + std::sin(angle) * offset.z(), offset.y(),
+			-std::sin(angle) * offset.x() + std::cos(angle) * offset.z());
+		path.add({ k / 2.0, scene.camera.lookat + rotated, scene.camera.lookat, scene.camera.vfov, scene.camera.focus_dist });
+	}
+
+	// spheres smaller than the big three hop once over the sequence, each at its own phase
+	std::vector<int> bouncing;
+	std::vector<Point3> rest;
+	for (int i = 0; i < scene.spheres.size(); i++)
+	{
+		if (!scene.spheres.is_padding(i) && scene.spheres.radius(i) < 0.5)
+		{
+			bouncing.push_back(i);
+			rest.push_back(scene.spheres.center(i));
+		}
+	}
+
+	SequenceRenderer sequence;
+	sequence.frame_count = frame_count;
+	sequence.animate = [&](int, double time)
+	{
+		for (size_t k = 0; k < bouncing.size(); k++)
+		{
+			double height = 0.5 * std::fabs(std::sin(PI * time + k));
+			scene.spheres.set_sphere(bouncing[k], rest[k] + Vec3(0, height, 0), scene.spheres.radius(bouncing[k]));
+		}
+		bvh.refit(scene.spheres);
+		camera.lights = LightList(scene.spheres, scene.materials);
+	};
+	return sequence.render(camera, path);
+}
+
+static bool parse_range(const char* text, int* range)
+{
+	// <first>:<end>, a non-empty half-open range
+	return std::sscanf(text, "%d:%d", &range[0], &range[1]) == 2 && 0 <= range[0] && range[0] < range[1];
+}
+
+int main(int argc, char** argv)
+{
+	std::string scene_path, save_path, obj_path, partial_path, checkpoint_path, resume_path, albedo_path, normal_path;
+	int instance_count = 0, frame_count = 0, samples_per_pixel = 0;
+	bool denoise = false, next_event_estimation = true;
+	SamplerType sampler = SamplerType::Independent;
+	bool sampler_given = false;
+	double checkpoint_seconds = 60.0;
+	double time_budget = 0.0, target_noise = 0.0, preview_seconds = 10.0;
+	int rows[2] = { 0, 0 }, samples[2] = { 0, 0 };		// 0, 0 is the whole image
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--save-scene") == 0 && i + 1 < argc)
+		{
+			save_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+		{
+			instance_count = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--obj") == 0 && i + 1 < argc)
+		{
+			obj_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			frame_count = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--rows") == 0 && i + 1 < argc && parse_range(argv[i + 1], rows))
+		{
+			i++;
+		}
+		else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc && parse_range(argv[i + 1], samples))
+		{
+			i++;
+		}
+		else if (std::strcmp(argv[i], "--partial") == 0 && i + 1 < argc)
+		{
+			partial_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--spp") == 0 && i + 1 < argc)
+		{
+			samples_per_pixel = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+		{
+			checkpoint_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--checkpoint-seconds") == 0 && i + 1 < argc)
+		{
+			checkpoint_seconds = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--resume") == 0 && i + 1 < argc)
+		{
+			resume_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--denoise") == 0)
+		{
+			denoise = true;
+		}
+		else if (std::strcmp(argv[i], "--no-nee") == 0)
+		{
+			next_event_estimation = false;
+		}
+		else if (std::strcmp(argv[i], "--albedo") == 0 && i + 1 < argc)
+		{
+			albedo_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--normal") == 0 && i + 1 < argc)
+		{
+			normal_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && parse_sampler(argv[i + 1], sampler))
+		{
+			sampler_given = true;
+			i++;
+		}
+		else if (std::strcmp(argv[i], "--time-budget") == 0 && i + 1 < argc)
+		{
+			time_budget = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--target-noise") == 0 && i + 1 < argc)
+		{
+			target_noise = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--preview-seconds") == 0 && i + 1 < argc)
+		{
+			preview_seconds = std::atof(argv[++i]);
+		}
+		else if (argv[i][0] != '-' && scene_path.empty())
+		{
+			scene_path = argv[i];
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0] << USAGE;
+			return 1;
+		}
+	}
+
+	// the demo scenes hold objects other than spheres, which scene files cannot
+	const bool demo_scene = instance_count > 0 || !obj_path.empty();
+	if (demo_scene && !(scene_path.empty() && save_path.empty() && (instance_count == 0 || obj_path.empty())))
+	{
+		std::cerr << "--instances and --obj build their own scene, which scene files cannot hold\n";
+		return 1;
+	}
+	if (frame_count > 0 && (demo_scene || !save_path.empty() || !partial_path.empty() || !checkpoint_path.empty()
+		|| !resume_path.empty()))
+	{
+		std::cerr << "--frames animates the spheres of the book scene or a scene file and only writes images\n";
+		return 1;
+	}
+	if (!partial_path.empty() && (denoise || !albedo_path.empty() || !normal_path.empty()))
+	{
+		std::cerr << "--denoise, --albedo and --normal work on finished images, partial buffers only hold samples\n";
+		return 1;
+	}
+
+	const bool progressive = time_budget > 0 || target_noise > 0;
+	if (progressive && (frame_count > 0 || !partial_path.empty()))
+	{
+		std::cerr << "--time-budget and --target-noise decide the samples of a single image, shares and sequences need fixed ones\n";
+		return 1;
+	}
+
+	Scene scene;
+	SceneBuilder builder;
+	bool built = true;
+	uint32_t scene_hash = 0;
+	if (instance_count > 0)
+	{
+		// the instanced scene is generated from its count alone
+		instanced_scene(builder, scene.camera, instance_count);
+		scene_hash = fnv1a(&instance_count, sizeof(instance_count));
+	}
+	else if (!obj_path.empty())
+		built = mesh_scene(builder, scene.camera, obj_path, scene_hash);
+	else if (scene_path.empty())
+		book_scene(scene);
+	else
+		built = load_scene(scene_path, scene);
+
+	if (!built)
+		return 1;
+	if (!demo_scene)
+		scene_hash = scene_content_hash(scene);
+
+	if (!save_path.empty())
+	{
+		if (!save_scene(scene, save_path))
+		{
+			std::clog << "Failed to write " << save_path << "\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	Timer timer("Render");
+
+	// the demo scenes come packed out of their builder, the spheres of the book scene and scene files go straight into
+	// a FlatBVH, which sequences refit as they animate them
+	PackedScene packed = builder.build();
+	std::unique_ptr<FlatBVH> bvh = demo_scene ? nullptr : std::make_unique<FlatBVH>(scene.spheres);
+
+	Camera camera(demo_scene ? packed.world() : *bvh, demo_scene ? packed.materials() : scene.materials);
+	scene.camera.apply(camera);
+	camera.scene_hash = scene_hash;
+
+	camera.first_row = rows[0];
+	camera.end_row = rows[1];
+	camera.first_sample = samples[0];
+	camera.end_sample = samples[1];
+	if (samples_per_pixel > 0)
+		camera.samples_per_pixel = samples_per_pixel;
+	else if (progressive)
+		camera.samples_per_pixel = 1 << 16;		// the budget or noise target ends the render instead
+	camera.progressive = progressive;
+	camera.time_budget = time_budget;
+	camera.target_noise = target_noise;
+	camera.preview_seconds = preview_seconds;
+	camera.checkpoint_path = checkpoint_path;
+	camera.checkpoint_seconds = checkpoint_seconds;
+	camera.resume_path = resume_path;
+	camera.denoise = denoise;
+	camera.albedo_path = albedo_path;
+	camera.normal_path = normal_path;
+	if (sampler_given)
+		camera.sampler = sampler;
+	camera.next_event_estimation = next_event_estimation;
+	if (!demo_scene)
+		camera.lights = LightList(scene.spheres, scene.materials);
+
+	if (frame_count > 0)
+		return render_sequence(camera, scene, *bvh, frame_count) ? 0 : 1;
+
+	if (!partial_path.empty())
+	{
+		// a share whose checkpoints failed is still written, one that could not resume has no samples to write
+		bool written = camera.render_framebuffer();
+		if (!written && camera.samples_reached() == 0)
+			return 1;
+
+		const Framebuffer& fb = camera.framebuffer();
+		PartialRange range = { rows[0], rows[1] > 0 ? std::min(rows[1], fb.height()) : fb.height(),
+			samples[0], samples[1] > 0 ? std::min(samples[1], camera.samples_per_pixel) : camera.samples_per_pixel,
+			camera.settings_hash() };
+		if (!write_partial(fb, range, partial_path))
+		{
+			std::clog << "\nFailed to write " << partial_path << "\n";
+			return 1;
+		}
+		return written ? 0 : 1;
+	}
 
-	camera.render();
+	camera.output_path = "image.png";
 
-	return 0;
+	return camera.render() ? 0 : 1;
 }
\ No newline at end of file
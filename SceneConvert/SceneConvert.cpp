@@ -0,0 +1,35 @@
+#include "RTWeekend.h"
+
+#include "SceneFile.h"
+
+#include <chrono>
+
+// converts scenes between the text and binary formats, the output format follows its extension (.bscene is binary)
+// usage: SceneConvert <input> <output>
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		std::cerr << "usage: " << argv[0] << " <input> <output>\n";
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Scene scene;
+	if (!load_scene(argv[1], scene))
+		return 1;
+	auto loaded = std::chrono::steady_clock::now();
+
+	if (!save_scene(scene, argv[2]))
+	{
+		std::clog << "Failed to write " << argv[2] << "\n";
+		return 1;
+	}
+	auto saved = std::chrono::steady_clock::now();
+
+	std::clog << scene.spheres.size() << " spheres, " << scene.materials.size() << " materials, loaded in "
+		<< std::chrono::duration<double>(loaded - start).count() << " s, written in "
+		<< std::chrono::duration<double>(saved - loaded).count() << " s\n";
+	return 0;
+}